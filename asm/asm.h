@@ -1,10 +1,12 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <ostream>
 #include "defid.h"
 #include "register.h"
 #include "../lexer/symbol.h"
+#include "../utils/runs.h"
 
 enum class AsmBinaryOp
 {
@@ -14,6 +16,17 @@ enum class AsmBinaryOp
   Mul,
   Mod,
   Lt,
+  And,
+  Or,
+  Xor,
+  Sh1Add,
+  Sh2Add,
+  Sh3Add,
+  Min,
+  Max,
+  Andn,
+  CzeroEqz,
+  CzeroNez,
 };
 
 enum class AsmBinaryImmOp
@@ -52,6 +65,10 @@ enum class AsmLabelSec
   Data,
   Rodata,
   Bss,
+  SData,
+  SRodata,
+  SBss,
+  FiniArray,
 };
 
 enum class AsmIntDirType
@@ -60,7 +77,25 @@ enum class AsmIntDirType
   Skip,
 };
 
-struct AsmLabelInfo;
+enum class AsmUnit
+{
+  Alu,
+  Mul,
+  Div,
+  Load,
+  Store,
+  Barrier,
+};
+
+enum class AsmFlow
+{
+  Inst,
+  Label,
+  Jump,
+  Branch,
+  Exit,
+  Barrier,
+};
 
 class AsmBuilder;
 
@@ -69,13 +104,31 @@ class AsmLine
 public:
   virtual void print(std::ostream &os) const = 0;
 
-  virtual bool is_label(void) const;
-  virtual void fill_label_info(size_t pos, AsmLabelInfo *info) const;
-  virtual void mark_label_used(std::vector<bool> &used_labels) const;
-  virtual std::unique_ptr<AsmLine> clone_if_jump(void) const;
+  virtual AsmFlow get_flow(unsigned int &label) const;
+  virtual std::unique_ptr<AsmLine> clone_if_exit(void) const;
+  virtual AsmLine *retarget(unsigned int dest) const;
+  virtual AsmLine *invert_branch(unsigned int dest) const;
   virtual AsmLine *update_label(
       const std::vector<size_t> &rules,
       std::vector<bool> &used);
+
+  virtual uint32_t get_defs(void) const;
+  virtual uint32_t get_uses(void) const;
+  virtual bool is_pure(void) const;
+  virtual AsmUnit get_unit(void) const;
+
+  virtual bool extract_if_move(Register &rd, Register &rs) const;
+  virtual bool extract_if_load_imm(Register &rd, AsmImm &imm) const;
+  virtual bool extract_if_binary(AsmBinaryOp &op,
+      Register &rd, Register &rs1, Register &rs2) const;
+  virtual bool extract_if_binary_imm(AsmBinaryImmOp &op,
+      Register &rd, Register &rs1, AsmImm &imm) const;
+  virtual bool extract_if_memory(AsmMemoryOp &op,
+      Register &reg, Register &addr, AsmImm &off) const;
+  virtual bool extract_if_load_addr(
+      Register &rd, const Symbol *&sym, AsmImm &off) const;
+  virtual bool extract_if_sym_memory(AsmMemoryOp &op,
+      Register &reg, const Symbol *&sym, AsmImm &off) const;
 };
 
 class AsmGlobalLabel :public AsmLine
@@ -87,6 +140,8 @@ public:
 
   void print(std::ostream &os) const override;
 
+  AsmFlow get_flow(unsigned int &label) const override;
+
 private:
   AsmLabelSec section;
   Symbol sym;
@@ -101,11 +156,45 @@ public:
 
   void print(std::ostream &os) const override;
 
+  AsmFlow get_flow(unsigned int &label) const override;
+
 private:
   AsmIntDirType type;
   AsmImm data;
 };
 
+/* Initial contents of `size` words, printed run by run. */
+class AsmDataDirective :public AsmLine
+{
+public:
+  AsmDataDirective(unsigned int size, DataRuns &&data)
+    : size(size), data(std::move(data))
+  {}
+
+  void print(std::ostream &os) const override;
+
+  AsmFlow get_flow(unsigned int &label) const override;
+
+private:
+  unsigned int size;
+  DataRuns data;
+};
+
+class AsmSymDirective :public AsmLine
+{
+public:
+  AsmSymDirective(Symbol sym)
+    : sym(sym)
+  {}
+
+  void print(std::ostream &os) const override;
+
+  AsmFlow get_flow(unsigned int &label) const override;
+
+private:
+  Symbol sym;
+};
+
 class AsmLocalLabel :public AsmLine
 {
 public:
@@ -115,8 +204,7 @@ public:
 
   void print(std::ostream &os) const override;
 
-  bool is_label(void) const override;
-  void fill_label_info(size_t pos, AsmLabelInfo *info) const override;
+  AsmFlow get_flow(unsigned int &label) const override;
   AsmLine *update_label(
       const std::vector<size_t> &rules,
       std::vector<bool> &used) override;
@@ -135,6 +223,13 @@ public:
 
   void print(std::ostream &os) const override;
 
+  uint32_t get_defs(void) const override;
+  uint32_t get_uses(void) const override;
+  bool is_pure(void) const override;
+  AsmUnit get_unit(void) const override;
+  bool extract_if_binary(AsmBinaryOp &op,
+      Register &rd, Register &rs1, Register &rs2) const override;
+
 private:
   AsmBinaryOp op;
   Register rd;
@@ -152,6 +247,13 @@ public:
 
   void print(std::ostream &os) const override;
 
+  uint32_t get_defs(void) const override;
+  uint32_t get_uses(void) const override;
+  bool is_pure(void) const override;
+  AsmUnit get_unit(void) const override;
+  bool extract_if_binary_imm(AsmBinaryImmOp &op,
+      Register &rd, Register &rs1, AsmImm &imm) const override;
+
 private:
   AsmBinaryImmOp op;
   Register rd;
@@ -169,6 +271,12 @@ public:
 
   void print(std::ostream &os) const override;
 
+  uint32_t get_defs(void) const override;
+  uint32_t get_uses(void) const override;
+  bool is_pure(void) const override;
+  AsmUnit get_unit(void) const override;
+  bool extract_if_move(Register &rd, Register &rs) const override;
+
 private:
   AsmUnaryOp op;
   Register rd;
@@ -184,6 +292,11 @@ public:
 
   void print(std::ostream &os) const override;
 
+  uint32_t get_defs(void) const override;
+  bool is_pure(void) const override;
+  AsmUnit get_unit(void) const override;
+  bool extract_if_load_imm(Register &rd, AsmImm &imm) const override;
+
 private:
   Register rd;
   AsmImm imm;
@@ -198,6 +311,12 @@ public:
 
   void print(std::ostream &os) const override;
 
+  uint32_t get_defs(void) const override;
+  bool is_pure(void) const override;
+  AsmUnit get_unit(void) const override;
+  bool extract_if_load_addr(
+      Register &rd, const Symbol *&sym, AsmImm &off) const override;
+
 private:
   Register rd;
   Symbol sym;
@@ -214,6 +333,13 @@ public:
 
   void print(std::ostream &os) const override;
 
+  uint32_t get_defs(void) const override;
+  uint32_t get_uses(void) const override;
+  bool is_pure(void) const override;
+  AsmUnit get_unit(void) const override;
+  bool extract_if_memory(AsmMemoryOp &op,
+      Register &reg, Register &addr, AsmImm &off) const override;
+
 private:
   AsmMemoryOp op;
   Register reg;
@@ -221,6 +347,36 @@ private:
   AsmImm off;
 };
 
+/*
+ * A load or store of a global through the `lw rd, sym` and
+ * `sw rs, sym, rt` pseudo-instructions, which the linker relaxes into a
+ * single gp-relative access for small data. A store clobbers `tmp`.
+ */
+class AsmSymMemoryInst :public AsmLine
+{
+public:
+  AsmSymMemoryInst(AsmMemoryOp op,
+      Register reg, Symbol sym, AsmImm off, Register tmp)
+    : op(op), reg(reg), sym(sym), off(off), tmp(tmp)
+  {}
+
+  void print(std::ostream &os) const override;
+
+  uint32_t get_defs(void) const override;
+  uint32_t get_uses(void) const override;
+  bool is_pure(void) const override;
+  AsmUnit get_unit(void) const override;
+  bool extract_if_sym_memory(AsmMemoryOp &op,
+      Register &reg, const Symbol *&sym, AsmImm &off) const override;
+
+private:
+  AsmMemoryOp op;
+  Register reg;
+  Symbol sym;
+  AsmImm off;
+  Register tmp;
+};
+
 class AsmCallInst :public AsmLine
 {
 public:
@@ -230,6 +386,9 @@ public:
 
   void print(std::ostream &os) const override;
 
+  uint32_t get_defs(void) const override;
+  uint32_t get_uses(void) const override;
+
 private:
   Symbol sym;
 };
@@ -243,9 +402,8 @@ public:
 
   void print(std::ostream &os) const override;
 
-  void fill_label_info(size_t pos, AsmLabelInfo *info) const override;
-  void mark_label_used(std::vector<bool> &used_labels) const override;
-  std::unique_ptr<AsmLine> clone_if_jump(void) const override;
+  AsmFlow get_flow(unsigned int &label) const override;
+  AsmLine *retarget(unsigned int dest) const override;
   AsmLine *update_label(
       const std::vector<size_t> &rules,
       std::vector<bool> &used) override;
@@ -264,10 +422,13 @@ public:
 
   void print(std::ostream &os) const override;
 
-  void mark_label_used(std::vector<bool> &used_labels) const override;
+  AsmFlow get_flow(unsigned int &label) const override;
+  AsmLine *retarget(unsigned int dest) const override;
+  AsmLine *invert_branch(unsigned int dest) const override;
   AsmLine *update_label(
       const std::vector<size_t> &rules,
       std::vector<bool> &used) override;
+  uint32_t get_uses(void) const override;
 
 private:
   AsmBranchOp op;
@@ -285,7 +446,9 @@ public:
 
   void print(std::ostream &os) const override;
 
-  std::unique_ptr<AsmLine> clone_if_jump(void) const override;
+  AsmFlow get_flow(unsigned int &label) const override;
+  std::unique_ptr<AsmLine> clone_if_exit(void) const override;
+  uint32_t get_uses(void) const override;
 
 private:
   Register rs;
@@ -303,6 +466,9 @@ class AsmFile
 public:
   AsmFile(AsmBuilder &&builder);
 
+  void optimize_branches(void);
+  void peephole(void);
+  void schedule(void);
   void relabel(void);
 
 private:
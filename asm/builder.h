@@ -28,6 +28,18 @@ public:
         std::make_unique<AsmIntDirective>(type, data));
   }
 
+  void mk_data_directive(unsigned int size, DataRuns &&data)
+  {
+    lines.emplace_back(
+        std::make_unique<AsmDataDirective>(size, std::move(data)));
+  }
+
+  void mk_sym_directive(Symbol sym)
+  {
+    lines.emplace_back(
+        std::make_unique<AsmSymDirective>(sym));
+  }
+
   void mk_local_label(MirLabel mirlabel)
   {
     assert(mirlabel < label_tail - label_head);
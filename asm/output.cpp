@@ -1,6 +1,9 @@
 #include "asm.h"
 #include "register.h"
 
+/* Words listed by one `.long` of an initialized array. */
+#define DATA_WORDS_PER_LINE  8
+
 const char *g_register_names[] = {
   "t0", "t1", "t2", "t3", "t4", "t5", "t6",
   "ra",
@@ -38,6 +41,39 @@ static std::ostream &operator <<(std::ostream &os, AsmBinaryOp op)
   case AsmBinaryOp::Lt:
     os << "slt";
     break;
+  case AsmBinaryOp::And:
+    os << "and";
+    break;
+  case AsmBinaryOp::Or:
+    os << "or";
+    break;
+  case AsmBinaryOp::Xor:
+    os << "xor";
+    break;
+  case AsmBinaryOp::Sh1Add:
+    os << "sh1add";
+    break;
+  case AsmBinaryOp::Sh2Add:
+    os << "sh2add";
+    break;
+  case AsmBinaryOp::Sh3Add:
+    os << "sh3add";
+    break;
+  case AsmBinaryOp::Min:
+    os << "min";
+    break;
+  case AsmBinaryOp::Max:
+    os << "max";
+    break;
+  case AsmBinaryOp::Andn:
+    os << "andn";
+    break;
+  case AsmBinaryOp::CzeroEqz:
+    os << "czero.eqz";
+    break;
+  case AsmBinaryOp::CzeroNez:
+    os << "czero.nez";
+    break;
   }
   return os;
 }
@@ -132,6 +168,18 @@ static std::ostream &operator <<(std::ostream &os, AsmLabelSec sec)
   case AsmLabelSec::Bss:
     os << ".bss";
     break;
+  case AsmLabelSec::SData:
+    os << ".sdata";
+    break;
+  case AsmLabelSec::SRodata:
+    os << ".srodata";
+    break;
+  case AsmLabelSec::SBss:
+    os << ".sbss";
+    break;
+  case AsmLabelSec::FiniArray:
+    os << ".fini_array";
+    break;
   }
   return os;
 }
@@ -162,6 +210,42 @@ void AsmIntDirective::print(std::ostream &os) const
   os << "  " << type << " " << data << "\n";
 }
 
+/*
+ * Zero gaps become `.skip` and repeated runs a single `.fill`; other
+ * words are listed several to a `.long`.
+ */
+void AsmDataDirective::print(std::ostream &os) const
+{
+  unsigned int now = 0;
+  for (const auto &run : data)
+  {
+    if (now != run.index)
+      os << "  .skip " << (run.index - now) * sizeof(int) << "\n";
+    if (run.repeat) {
+      os << "  .fill " << run.count << ", " << sizeof(int) << ", "
+         << run.value << "\n";
+    } else {
+      const int *words = data.get_words(run);
+      for (unsigned int i = 0; i < run.count; i += DATA_WORDS_PER_LINE)
+      {
+        os << "  .long " << words[i];
+        for (unsigned int j = i + 1;
+            j < run.count && j < i + DATA_WORDS_PER_LINE; ++j)
+          os << ", " << words[j];
+        os << "\n";
+      }
+    }
+    now = run.index + run.count;
+  }
+  if (now != size)
+    os << "  .skip " << (size - now) * sizeof(int) << "\n";
+}
+
+void AsmSymDirective::print(std::ostream &os) const
+{
+  os << "  .long " << sym.to_string() << "\n";
+}
+
 void AsmLocalLabel::print(std::ostream &os) const
 {
   os << labelid << ":\n";
@@ -245,6 +329,21 @@ void AsmMemoryInst::print(std::ostream &os) const
      << "\n";
 }
 
+void AsmSymMemoryInst::print(std::ostream &os) const
+{
+  os << "  "
+     << op
+     << " "
+     << reg
+     << ", "
+     << sym.to_string()
+     << (off >= 0 ? "+" : "")
+     << off;
+  if (op == AsmMemoryOp::Store)
+    os << ", " << tmp;
+  os << "\n";
+}
+
 void AsmCallInst::print(std::ostream &os) const
 {
   os << "  "
@@ -278,6 +377,13 @@ void AsmBranchInst::print(std::ostream &os) const
 
 void AsmJumpRegInst::print(std::ostream &os) const
 {
+  if (rs == Register::RA) {
+    os << "  "
+       << "ret"
+       << "\n";
+    return;
+  }
+
   os << "  "
      << "jr"
      << " "
@@ -0,0 +1,646 @@
+#include <vector>
+#include <algorithm>
+#include "asm.h"
+
+/* How far a rule looks ahead for the partner of an instruction. */
+#define PEEPHOLE_WINDOW  32
+
+/* Registers whose values a function must hand back to its caller. */
+#define MASK_REG_EXIT    (MASK_REG_CALLEE | reg_mask(Register::A0) \
+    | reg_mask(Register::SP) | reg_mask(Register::GP) \
+    | reg_mask(Register::TP))
+
+static uint32_t reg_mask(Register reg)
+{
+  if (reg == Register::X0 || reg == Register::UND)
+    return 0;
+  return 1u << static_cast<uint32_t>(reg);
+}
+
+static bool is_imm12(AsmImm imm)
+{
+  return imm >= -2048 && imm <= 2047;
+}
+
+static bool is_offset(AsmImm imm)
+{
+  return imm >= -2047 && imm <= 2047;
+}
+
+uint32_t AsmLine::get_defs(void) const
+{
+  return 0;
+}
+
+uint32_t AsmBinaryInst::get_defs(void) const
+{
+  return reg_mask(rd);
+}
+
+uint32_t AsmBinaryImmInst::get_defs(void) const
+{
+  return reg_mask(rd);
+}
+
+uint32_t AsmUnaryInst::get_defs(void) const
+{
+  return reg_mask(rd);
+}
+
+uint32_t AsmLoadImmInst::get_defs(void) const
+{
+  return reg_mask(rd);
+}
+
+uint32_t AsmLoadAddrInst::get_defs(void) const
+{
+  return reg_mask(rd);
+}
+
+uint32_t AsmMemoryInst::get_defs(void) const
+{
+  return op == AsmMemoryOp::Load ? reg_mask(reg) : 0;
+}
+
+uint32_t AsmSymMemoryInst::get_defs(void) const
+{
+  return reg_mask(op == AsmMemoryOp::Load ? reg : tmp);
+}
+
+uint32_t AsmCallInst::get_defs(void) const
+{
+  return MASK_REG_CALLER;
+}
+
+uint32_t AsmLine::get_uses(void) const
+{
+  return 0;
+}
+
+uint32_t AsmBinaryInst::get_uses(void) const
+{
+  return reg_mask(rs1) | reg_mask(rs2);
+}
+
+uint32_t AsmBinaryImmInst::get_uses(void) const
+{
+  return reg_mask(rs1);
+}
+
+uint32_t AsmUnaryInst::get_uses(void) const
+{
+  return reg_mask(rs);
+}
+
+uint32_t AsmMemoryInst::get_uses(void) const
+{
+  if (op == AsmMemoryOp::Load)
+    return reg_mask(addr);
+  return reg_mask(reg) | reg_mask(addr);
+}
+
+uint32_t AsmSymMemoryInst::get_uses(void) const
+{
+  return op == AsmMemoryOp::Store ? reg_mask(reg) : 0;
+}
+
+uint32_t AsmCallInst::get_uses(void) const
+{
+  uint32_t mask = 0;
+  for (uint32_t i = 1; i <= 8; ++i)
+    mask |= reg_mask(reg_from_arg_id(i));
+  return mask;
+}
+
+uint32_t AsmBranchInst::get_uses(void) const
+{
+  return reg_mask(rs1) | reg_mask(rs2);
+}
+
+uint32_t AsmJumpRegInst::get_uses(void) const
+{
+  return reg_mask(rs);
+}
+
+bool AsmLine::is_pure(void) const
+{
+  return false;
+}
+
+bool AsmBinaryInst::is_pure(void) const
+{
+  return true;
+}
+
+bool AsmBinaryImmInst::is_pure(void) const
+{
+  return true;
+}
+
+bool AsmUnaryInst::is_pure(void) const
+{
+  return op != AsmUnaryOp::Jump;
+}
+
+bool AsmLoadImmInst::is_pure(void) const
+{
+  return true;
+}
+
+bool AsmLoadAddrInst::is_pure(void) const
+{
+  return true;
+}
+
+bool AsmMemoryInst::is_pure(void) const
+{
+  return op == AsmMemoryOp::Load;
+}
+
+bool AsmSymMemoryInst::is_pure(void) const
+{
+  return op == AsmMemoryOp::Load;
+}
+
+bool AsmLine::extract_if_move(Register &rd, Register &rs) const
+{
+  return false;
+}
+
+bool AsmUnaryInst::extract_if_move(Register &rd, Register &rs) const
+{
+  if (op != AsmUnaryOp::Mv)
+    return false;
+  rd = this->rd;
+  rs = this->rs;
+  return true;
+}
+
+bool AsmLine::extract_if_load_imm(Register &rd, AsmImm &imm) const
+{
+  return false;
+}
+
+bool AsmLoadImmInst::extract_if_load_imm(Register &rd, AsmImm &imm) const
+{
+  rd = this->rd;
+  imm = this->imm;
+  return true;
+}
+
+bool AsmLine::extract_if_binary(AsmBinaryOp &op,
+    Register &rd, Register &rs1, Register &rs2) const
+{
+  return false;
+}
+
+bool AsmBinaryInst::extract_if_binary(AsmBinaryOp &op,
+    Register &rd, Register &rs1, Register &rs2) const
+{
+  op = this->op;
+  rd = this->rd;
+  rs1 = this->rs1;
+  rs2 = this->rs2;
+  return true;
+}
+
+bool AsmLine::extract_if_binary_imm(AsmBinaryImmOp &op,
+    Register &rd, Register &rs1, AsmImm &imm) const
+{
+  return false;
+}
+
+bool AsmBinaryImmInst::extract_if_binary_imm(AsmBinaryImmOp &op,
+    Register &rd, Register &rs1, AsmImm &imm) const
+{
+  op = this->op;
+  rd = this->rd;
+  rs1 = this->rs1;
+  imm = this->rs2;
+  return true;
+}
+
+bool AsmLine::extract_if_memory(AsmMemoryOp &op,
+    Register &reg, Register &addr, AsmImm &off) const
+{
+  return false;
+}
+
+bool AsmMemoryInst::extract_if_memory(AsmMemoryOp &op,
+    Register &reg, Register &addr, AsmImm &off) const
+{
+  op = this->op;
+  reg = this->reg;
+  addr = this->addr;
+  off = this->off;
+  return true;
+}
+
+bool AsmLine::extract_if_load_addr(
+    Register &rd, const Symbol *&sym, AsmImm &off) const
+{
+  return false;
+}
+
+bool AsmLoadAddrInst::extract_if_load_addr(
+    Register &rd, const Symbol *&sym, AsmImm &off) const
+{
+  rd = this->rd;
+  sym = &this->sym;
+  off = this->off;
+  return true;
+}
+
+bool AsmLine::extract_if_sym_memory(AsmMemoryOp &op,
+    Register &reg, const Symbol *&sym, AsmImm &off) const
+{
+  return false;
+}
+
+bool AsmSymMemoryInst::extract_if_sym_memory(AsmMemoryOp &op,
+    Register &reg, const Symbol *&sym, AsmImm &off) const
+{
+  op = this->op;
+  reg = this->reg;
+  sym = &this->sym;
+  off = this->off;
+  return true;
+}
+
+/*
+ * A straight-line run of instructions. Erased lines are left as null
+ * pointers until the whole file has been processed.
+ */
+class AsmPeepholeBlock
+{
+public:
+  AsmPeepholeBlock(std::unique_ptr<AsmLine> *lines, size_t size,
+      uint32_t live_out)
+    : lines(lines), size(size), live_out(live_out)
+  {}
+
+  size_t end(void) const { return size; }
+  AsmLine *at(size_t i) const { return lines[i].get(); }
+
+  size_t next(size_t i) const
+  {
+    for (++i; i < size && !lines[i]; ++i);
+    return i;
+  }
+
+  void replace(size_t i, AsmLine *line) { lines[i].reset(line); }
+  void erase(size_t i) { lines[i] = nullptr; }
+
+  /* The next line reading `reg` before it is redefined, or end(). */
+  size_t find_use(size_t i, Register reg) const
+  {
+    uint32_t mask = reg_mask(reg);
+    unsigned int steps = 0;
+    for (i = next(i); i < size && steps < PEEPHOLE_WINDOW; i = next(i))
+    {
+      if (lines[i]->get_uses() & mask)
+        return i;
+      if (lines[i]->get_defs() & mask)
+        break;
+      ++steps;
+    }
+    return size;
+  }
+
+  /* Whether no line strictly between `from` and `to` writes `reg`. */
+  bool is_unchanged(size_t from, size_t to, Register reg) const
+  {
+    uint32_t mask = reg_mask(reg);
+    for (size_t i = next(from); i < to; i = next(i))
+      if (lines[i]->get_defs() & mask)
+        return false;
+    return true;
+  }
+
+  /* Whether the value of `reg` after line `i` is never read. */
+  bool is_dead_after(size_t i, Register reg) const
+  {
+    uint32_t mask = reg_mask(reg);
+    unsigned int steps = 0;
+    for (i = next(i); i < size; i = next(i))
+    {
+      if (lines[i]->get_uses() & mask)
+        return false;
+      if (lines[i]->get_defs() & mask)
+        return true;
+      if (++steps == PEEPHOLE_WINDOW)
+        return false;
+    }
+    return !(live_out & mask);
+  }
+
+private:
+  std::unique_ptr<AsmLine> *lines;
+  size_t size;
+  uint32_t live_out;
+};
+
+/*
+ *   sw r, off(a); ...; lw d, off(a)  =>  sw r, off(a); ...; mv d, r
+ *   sw r, sym, t; ...; lw d, sym     =>  sw r, sym, t; ...; mv d, r
+ *
+ * Any store or call in between may write the slot, so the search stops
+ * there, as well as at a redefinition of `r` or `a`.
+ */
+static bool forward_store(AsmPeepholeBlock &block, size_t i)
+{
+  AsmMemoryOp op;
+  Register reg, addr = Register::UND;
+  const Symbol *sym = nullptr;
+  AsmImm off;
+  if ((!block.at(i)->extract_if_memory(op, reg, addr, off)
+        && !block.at(i)->extract_if_sym_memory(op, reg, sym, off))
+      || op != AsmMemoryOp::Store)
+    return false;
+
+  uint32_t kill = reg_mask(reg) | reg_mask(addr);
+  unsigned int steps = 0;
+  for (size_t j = block.next(i);
+      j < block.end() && steps < PEEPHOLE_WINDOW;
+      j = block.next(j), ++steps)
+  {
+    AsmMemoryOp op2;
+    Register reg2, addr2;
+    const Symbol *sym2;
+    AsmImm off2;
+    bool same = sym
+      ? block.at(j)->extract_if_sym_memory(op2, reg2, sym2, off2)
+        && *sym2 == *sym
+      : block.at(j)->extract_if_memory(op2, reg2, addr2, off2)
+        && addr2 == addr;
+    if (same && op2 == AsmMemoryOp::Load && off2 == off) {
+      if (reg2 == reg)
+        block.erase(j);
+      else
+        block.replace(j, new AsmUnaryInst(AsmUnaryOp::Mv, reg2, reg));
+      return true;
+    }
+    if (!block.at(j)->is_pure() || (block.at(j)->get_defs() & kill))
+      break;
+  }
+  return false;
+}
+
+/* mv a, b; mv b, a  =>  mv a, b */
+static bool remove_move_pair(AsmPeepholeBlock &block, size_t i)
+{
+  Register rd, rs, rd2, rs2;
+  size_t j = block.next(i);
+  if (j >= block.end()
+      || !block.at(i)->extract_if_move(rd, rs)
+      || !block.at(j)->extract_if_move(rd2, rs2)
+      || rd2 != rs || rs2 != rd)
+    return false;
+  block.erase(j);
+  return true;
+}
+
+/* li r, imm; ...; li r, imm  =>  li r, imm; ... */
+static bool remove_imm_reload(AsmPeepholeBlock &block, size_t i)
+{
+  Register rd, rd2;
+  AsmImm imm, imm2;
+  if (!block.at(i)->extract_if_load_imm(rd, imm))
+    return false;
+
+  uint32_t mask = reg_mask(rd);
+  unsigned int steps = 0;
+  for (size_t j = block.next(i);
+      j < block.end() && steps < PEEPHOLE_WINDOW;
+      j = block.next(j), ++steps)
+  {
+    if (block.at(j)->extract_if_load_imm(rd2, imm2)
+        && rd2 == rd && imm2 == imm) {
+      block.erase(j);
+      return true;
+    }
+    if (block.at(j)->get_defs() & mask)
+      break;
+  }
+  return false;
+}
+
+/*
+ *   li t, imm; ...; add d, x, t  =>  ...; addi d, x, imm
+ *   li t, imm; ...; sub d, x, t  =>  ...; addi d, x, -imm
+ *   li t, imm; ...; slt d, x, t  =>  ...; slti d, x, imm
+ *
+ * when `t` is not read afterwards.
+ */
+static bool fold_imm_operand(AsmPeepholeBlock &block, size_t i)
+{
+  Register tmp, rd, rs1, rs2;
+  AsmImm imm;
+  AsmBinaryOp op;
+  if (!block.at(i)->extract_if_load_imm(tmp, imm) || !is_imm12(imm))
+    return false;
+
+  size_t j = block.find_use(i, tmp);
+  if (j >= block.end() || !block.at(j)->extract_if_binary(op, rd, rs1, rs2))
+    return false;
+  if (op == AsmBinaryOp::Add && rs1 == tmp)
+    std::swap(rs1, rs2);
+  if (rs1 == tmp || rs2 != tmp || (rd != tmp && !block.is_dead_after(j, tmp)))
+    return false;
+
+  AsmBinaryImmOp iop;
+  switch (op)
+  {
+  case AsmBinaryOp::Add:
+    iop = AsmBinaryImmOp::Add;
+    break;
+  case AsmBinaryOp::Sub:
+    if (!is_imm12(-imm))
+      return false;
+    iop = AsmBinaryImmOp::Add;
+    imm = -imm;
+    break;
+  case AsmBinaryOp::Lt:
+    iop = AsmBinaryImmOp::Lt;
+    break;
+  default:
+    return false;
+  }
+
+  if (iop == AsmBinaryImmOp::Add && imm == 0)
+    block.replace(j, new AsmUnaryInst(AsmUnaryOp::Mv, rd, rs1));
+  else
+    block.replace(j, new AsmBinaryImmInst(iop, rd, rs1, imm));
+  block.erase(i);
+  return true;
+}
+
+/*
+ *   addi t, a, k; ...; addi d, t, m    =>  ...; addi d, a, k+m
+ *   addi t, a, k; ...; lw r, off(t)    =>  ...; lw r, off+k(a)
+ *   addi t, a, k; ...; sw r, off(t)    =>  ...; sw r, off+k(a)
+ *
+ * when `t` is not read afterwards and `a` still holds the same value.
+ */
+static bool fold_addi(AsmPeepholeBlock &block, size_t i)
+{
+  AsmBinaryImmOp op;
+  Register tmp, base;
+  AsmImm k;
+  if (!block.at(i)->extract_if_binary_imm(op, tmp, base, k)
+      || op != AsmBinaryImmOp::Add)
+    return false;
+
+  size_t j = block.find_use(i, tmp);
+  if (j >= block.end() || !block.is_unchanged(i, j, base))
+    return false;
+
+  Register rd, rs;
+  AsmImm m;
+  AsmMemoryOp mop;
+  if (block.at(j)->extract_if_binary_imm(op, rd, rs, m)) {
+    if (op != AsmBinaryImmOp::Add || !is_imm12(k + m)
+        || (rd != tmp && !block.is_dead_after(j, tmp)))
+      return false;
+    if (k + m == 0)
+      block.replace(j, new AsmUnaryInst(AsmUnaryOp::Mv, rd, base));
+    else
+      block.replace(j, new AsmBinaryImmInst(AsmBinaryImmOp::Add,
+            rd, base, k + m));
+  } else if (block.at(j)->extract_if_memory(mop, rd, rs, m)) {
+    bool redefined = mop == AsmMemoryOp::Load && rd == tmp;
+    if (rs != tmp || !is_offset(k + m)
+        || (mop == AsmMemoryOp::Store && rd == tmp)
+        || (!redefined && !block.is_dead_after(j, tmp)))
+      return false;
+    block.replace(j, new AsmMemoryInst(mop, rd, base, k + m));
+  } else {
+    return false;
+  }
+
+  block.erase(i);
+  return true;
+}
+
+/*
+ *   la t, sym+k; ...; lw r, off(t)  =>  ...; lw r, sym+k+off
+ *   la t, sym+k; ...; sw r, off(t)  =>  ...; sw r, sym+k+off, t
+ *
+ * when the address in `t` is only read by these accesses. Each symbolic
+ * form takes as many instructions as the `la` itself and the linker
+ * relaxes it into a single gp-relative access for data in the small
+ * sections, so at most two accesses are folded.
+ */
+static bool fold_symbol_access(AsmPeepholeBlock &block, size_t i)
+{
+  Register tmp;
+  const Symbol *sym;
+  AsmImm k;
+  if (!block.at(i)->extract_if_load_addr(tmp, sym, k))
+    return false;
+
+  size_t uses[2];
+  unsigned int nr_uses = 0;
+  for (size_t j = i; ; )
+  {
+    AsmMemoryOp op;
+    Register reg, addr;
+    AsmImm off;
+    j = block.find_use(j, tmp);
+    if (nr_uses == 2 || j >= block.end()
+        || !block.at(j)->extract_if_memory(op, reg, addr, off)
+        || addr != tmp || (op == AsmMemoryOp::Store && reg == tmp))
+      return false;
+
+    uses[nr_uses++] = j;
+    if ((op == AsmMemoryOp::Load && reg == tmp) || block.is_dead_after(j, tmp))
+      break;
+  }
+
+  for (unsigned int u = 0; u < nr_uses; ++u)
+  {
+    AsmMemoryOp op;
+    Register reg, addr;
+    AsmImm off;
+    block.at(uses[u])->extract_if_memory(op, reg, addr, off);
+    block.replace(uses[u],
+        new AsmSymMemoryInst(op, reg, *sym, k + off, tmp));
+  }
+  block.erase(i);
+  return true;
+}
+
+/* A pure instruction whose result is overwritten before being read. */
+static bool remove_dead_write(AsmPeepholeBlock &block, size_t i)
+{
+  uint32_t defs = block.at(i)->get_defs();
+  if (!block.at(i)->is_pure() || defs == 0 || (defs & (defs - 1)) != 0
+      || defs == reg_mask(Register::SP))
+    return false;
+
+  Register reg = static_cast<Register>(__builtin_ctz(defs));
+  if (!block.is_dead_after(i, reg))
+    return false;
+  block.erase(i);
+  return true;
+}
+
+struct AsmPeepholeRule
+{
+  const char *name;
+  bool (*apply)(AsmPeepholeBlock &block, size_t i);
+};
+
+static const AsmPeepholeRule g_peephole_rules[] = {
+  { "forward-store", forward_store },
+  { "move-pair", remove_move_pair },
+  { "imm-reload", remove_imm_reload },
+  { "imm-operand", fold_imm_operand },
+  { "addi-fold", fold_addi },
+  { "symbol-access", fold_symbol_access },
+  { "dead-write", remove_dead_write },
+};
+
+/*
+ * Applies the rules of g_peephole_rules to every straight-line run of
+ * instructions until none of them matches. Registers are assumed live
+ * at labels and branches, while only the callee-saved registers, the
+ * return value and those read by the exit itself survive a return.
+ */
+void AsmFile::peephole(void)
+{
+  const size_t n = lines.size();
+  size_t begin = 0;
+  while (begin < n)
+  {
+    unsigned int label;
+    size_t end = begin;
+    while (end < n && lines[end]->get_flow(label) == AsmFlow::Inst)
+      ++end;
+
+    uint32_t live_out = ~0u;
+    if (end < n && lines[end]->get_flow(label) == AsmFlow::Exit)
+      live_out = MASK_REG_EXIT | lines[end]->get_uses();
+
+    AsmPeepholeBlock block(&lines[begin], end - begin, live_out);
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+      for (size_t i = 0; i < block.end(); i = block.next(i))
+      {
+        if (!block.at(i))
+          continue;
+        for (const auto &rule : g_peephole_rules)
+          if (block.at(i) && rule.apply(block, i))
+            changed = true;
+      }
+    }
+
+    begin = end + 1;
+  }
+
+  lines.erase(std::remove_if(lines.begin(), lines.end(),
+        [] (const std::unique_ptr<AsmLine> &line) { return !line; }),
+      lines.end());
+}
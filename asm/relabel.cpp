@@ -1,84 +1,100 @@
 #include <vector>
-#include <stack>
+#include <algorithm>
 #include "asm.h"
 
-struct AsmLabelInfo
+AsmFlow AsmLine::get_flow(unsigned int &label) const
 {
-  AsmLabelInfo(size_t nr_lines, size_t nr_labels)
-    : jump_dest(), label_inst(), pending_labels()
-  {
-    jump_dest.resize(nr_lines, ~0ul);
-    label_inst.resize(nr_labels, ~0ul);
-  }
-
-  void reset(void)
-  {
-    std::fill(jump_dest.begin(), jump_dest.end(), ~0ul);
-    std::fill(label_inst.begin(), label_inst.end(), ~0ul);
-  }
+  return AsmFlow::Inst;
+}
 
-  std::vector<size_t> jump_dest;
-  std::vector<size_t> label_inst;
-  std::stack<size_t> pending_labels;
-};
+AsmFlow AsmGlobalLabel::get_flow(unsigned int &label) const
+{
+  return AsmFlow::Barrier;
+}
 
-void AsmLine::fill_label_info(size_t pos, AsmLabelInfo *info) const
+AsmFlow AsmIntDirective::get_flow(unsigned int &label) const
 {
-  while (!info->pending_labels.empty())
-  {
-    info->label_inst[info->pending_labels.top()] = pos;
-    info->pending_labels.pop();
-  }
+  return AsmFlow::Barrier;
 }
 
-void AsmLocalLabel::fill_label_info(size_t pos, AsmLabelInfo *info) const
+AsmFlow AsmDataDirective::get_flow(unsigned int &label) const
 {
-  info->pending_labels.push(labelid.id);
+  return AsmFlow::Barrier;
 }
 
-void AsmJumpInst::fill_label_info(size_t pos, AsmLabelInfo *info) const
+AsmFlow AsmSymDirective::get_flow(unsigned int &label) const
 {
-  AsmLine::fill_label_info(pos, info);
+  return AsmFlow::Barrier;
+}
 
-  info->jump_dest[pos] = target.id;
+AsmFlow AsmLocalLabel::get_flow(unsigned int &label) const
+{
+  label = labelid.id;
+  return AsmFlow::Label;
 }
 
-bool AsmLine::is_label(void) const
+AsmFlow AsmJumpInst::get_flow(unsigned int &label) const
 {
-  return false;
+  label = target.id;
+  return AsmFlow::Jump;
 }
 
-bool AsmLocalLabel::is_label(void) const
+AsmFlow AsmBranchInst::get_flow(unsigned int &label) const
 {
-  return true;
+  label = target.id;
+  return AsmFlow::Branch;
 }
 
-void AsmLine::mark_label_used(std::vector<bool> &used_labels) const
-{ /* nothing */ }
+AsmFlow AsmJumpRegInst::get_flow(unsigned int &label) const
+{
+  return AsmFlow::Exit;
+}
 
-void AsmJumpInst::mark_label_used(std::vector<bool> &used_labels) const
+std::unique_ptr<AsmLine> AsmLine::clone_if_exit(void) const
 {
-  used_labels[target.id] = true;
+  return nullptr;
 }
 
-void AsmBranchInst::mark_label_used(std::vector<bool> &used_labels) const
+std::unique_ptr<AsmLine> AsmJumpRegInst::clone_if_exit(void) const
 {
-  used_labels[target.id] = true;
+  return std::make_unique<AsmJumpRegInst>(rs);
 }
 
-std::unique_ptr<AsmLine> AsmLine::clone_if_jump(void) const
+AsmLine *AsmLine::retarget(unsigned int) const
 {
   return nullptr;
 }
 
-std::unique_ptr<AsmLine> AsmJumpInst::clone_if_jump(void) const
+AsmLine *AsmJumpInst::retarget(unsigned int dest) const
 {
-  return std::make_unique<AsmJumpInst>(target);
+  return new AsmJumpInst(AsmLabelId(dest));
 }
 
-std::unique_ptr<AsmLine> AsmJumpRegInst::clone_if_jump(void) const
+AsmLine *AsmBranchInst::retarget(unsigned int dest) const
 {
-  return std::make_unique<AsmJumpRegInst>(rs);
+  return new AsmBranchInst(op, rs1, rs2, AsmLabelId(dest));
+}
+
+AsmLine *AsmLine::invert_branch(unsigned int) const
+{
+  return nullptr;
+}
+
+AsmLine *AsmBranchInst::invert_branch(unsigned int dest) const
+{
+  AsmLabelId newtarget(dest);
+  switch (op)
+  {
+  case AsmBranchOp::Lt:
+    return new AsmBranchInst(AsmBranchOp::Leq, rs2, rs1, newtarget);
+  case AsmBranchOp::Leq:
+    return new AsmBranchInst(AsmBranchOp::Lt, rs2, rs1, newtarget);
+  case AsmBranchOp::Eq:
+    return new AsmBranchInst(AsmBranchOp::Ne, rs1, rs2, newtarget);
+  case AsmBranchOp::Ne:
+    return new AsmBranchInst(AsmBranchOp::Eq, rs1, rs2, newtarget);
+  }
+  return nullptr;
 }
 
 AsmLine *AsmLine::update_label(
@@ -112,70 +128,194 @@ AsmLine *AsmBranchInst::update_label(
   return new AsmBranchInst(op, rs1, rs2, AsmLabelId(rules[target.id]));
 }
 
-void AsmFile::relabel(void)
+/*
+ * Simplifies control flow between local labels until nothing changes:
+ *
+ *   j L; ... L: j M      => j M                (jump threading)
+ *   bcc L; ... L: j M    => bcc M
+ *   j L; ... L: ret      => ret
+ *   j L; L:              =>                    (fall-through)
+ *   bcc L; L:            =>
+ *   bcc L; j M; L:       => b!cc M; L:         (branch inversion)
+ *   j L; <no label> ...  => j L                (unreachable code)
+ *
+ * The lines form a linked list, so removals are O(1). A line is only
+ * revisited when one of its neighbours or its target changes, and label
+ * chains are resolved once and memoized, which keeps the whole pass linear.
+ */
+void AsmFile::optimize_branches(void)
 {
-  AsmLabelInfo info(lines.size(), num_labels);
-  for (size_t i = 0; i < lines.size(); ++i)
-    lines[i]->fill_label_info(i, &info);
+  const size_t n = lines.size();
+  std::vector<AsmFlow> flow(n);
+  std::vector<unsigned int> dest(n, ~0u);
+  std::vector<size_t> prev(n), next(n);
+  std::vector<size_t> label_line(num_labels, ~0ul);
+  std::vector<unsigned int> uses(num_labels, 0);
+  std::vector<unsigned int> final_label(num_labels, ~0u);
+  std::vector<size_t> worklist;
 
-  for (size_t i = lines.size() - 1; ~i; --i)
+  for (size_t i = 0; i < n; ++i)
   {
-    if (~info.jump_dest[i] == 0)
-      continue;
-    size_t j = info.label_inst[info.jump_dest[i]];
-    assert(~j != 0);
-
-    if (j == i)
-      continue;
-    if (auto newline = lines[j]->clone_if_jump();
-        newline != nullptr)
-      lines[i] = std::move(newline);
+    flow[i] = lines[i]->get_flow(dest[i]);
+    prev[i] = i - 1;
+    next[i] = i + 1;
+    if (flow[i] == AsmFlow::Label)
+      label_line[dest[i]] = i;
+    else if (flow[i] == AsmFlow::Jump || flow[i] == AsmFlow::Branch)
+      ++uses[dest[i]];
   }
 
-  info.reset();
-  for(size_t i = 0; i < lines.size(); ++i)
-    lines[i]->fill_label_info(i, &info);
+  auto push = [&] (size_t i) {
+    if (i < n && lines[i])
+      worklist.emplace_back(i);
+  };
 
-  for (size_t i = lines.size() - 1, j = lines.size();
-      ~i;
-      --i)
+  /* First line after `i` that is not a label, or n. */
+  auto inst_after = [&] (size_t i) {
+    for (i = next[i]; i < n && flow[i] == AsmFlow::Label; i = next[i]);
+    return i;
+  };
+
+  std::vector<size_t> dead;
+  auto erase = [&] (size_t i) {
+    dead.emplace_back(i);
+    while (!dead.empty())
+    {
+      i = dead.back();
+      dead.pop_back();
+      if (!lines[i])
+        continue;
+
+      if (prev[i] < n)
+        next[prev[i]] = next[i];
+      if (next[i] < n)
+        prev[next[i]] = prev[i];
+      lines[i] = nullptr;
+      push(prev[i]);
+
+      if ((flow[i] == AsmFlow::Jump || flow[i] == AsmFlow::Branch)
+          && --uses[dest[i]] == 0)
+        dead.emplace_back(label_line[dest[i]]);
+    }
+  };
+
+  auto resolve = [&] (unsigned int label) {
+    std::vector<unsigned int> chain;
+    while (final_label[label] == ~0u)
+    {
+      final_label[label] = label;
+      chain.emplace_back(label);
+      size_t i = inst_after(label_line[label]);
+      if (i >= n || flow[i] != AsmFlow::Jump)
+        break;
+      label = dest[i];
+    }
+    for (auto visited : chain)
+      final_label[visited] = final_label[label];
+    return final_label[label];
+  };
+
+  auto set_target = [&] (size_t i, AsmLine *newline, unsigned int label) {
+    unsigned int old = dest[i];
+    ++uses[label];
+    lines[i].reset(newline);
+    dest[i] = label;
+    if (--uses[old] == 0)
+      erase(label_line[old]);
+  };
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (flow[i] == AsmFlow::Label && uses[dest[i]] == 0)
+      erase(i);
+    else if (flow[i] != AsmFlow::Inst && flow[i] != AsmFlow::Barrier)
+      push(i);
+  }
+
+  while (!worklist.empty())
   {
-    if (!lines[i]->is_label())
-      j = i;
-    if (~info.jump_dest[i] == 0)
+    size_t i = worklist.back();
+    worklist.pop_back();
+    if (!lines[i] || flow[i] == AsmFlow::Label || flow[i] == AsmFlow::Inst
+        || flow[i] == AsmFlow::Barrier)
       continue;
-    if (info.label_inst[info.jump_dest[i]] == j)
-      lines[i] = nullptr;
+
+    if (flow[i] == AsmFlow::Jump || flow[i] == AsmFlow::Branch) {
+      unsigned int label = resolve(dest[i]);
+      if (label != dest[i])
+        set_target(i, lines[i]->retarget(label), label);
+
+      size_t target = inst_after(label_line[dest[i]]);
+      if (target == inst_after(i)) {
+        erase(i);
+        continue;
+      }
+
+      if (flow[i] == AsmFlow::Branch) {
+        size_t j = next[i];
+        if (j < n && flow[j] == AsmFlow::Jump && target == inst_after(j)) {
+          set_target(i, lines[i]->invert_branch(dest[j]), dest[j]);
+          erase(j);
+          push(i);
+        }
+        continue;
+      }
+
+      if (target < n && flow[target] == AsmFlow::Exit) {
+        unsigned int old = dest[i];
+        lines[i] = lines[target]->clone_if_exit();
+        flow[i] = AsmFlow::Exit;
+        if (--uses[old] == 0)
+          erase(label_line[old]);
+      }
+    }
+
+    if (!lines[i])
+      continue;
+    for (size_t j = next[i];
+        j < n && flow[j] != AsmFlow::Label && flow[j] != AsmFlow::Barrier;
+        j = next[i])
+      erase(j);
   }
 
   lines.erase(std::remove_if(lines.begin(), lines.end(),
         [] (const std::unique_ptr<AsmLine> &line) { return !line; }),
       lines.end());
+}
 
-  std::vector<std::pair<size_t, size_t>> labels;
-  for (size_t i = 0; i < info.label_inst.size(); ++i)
-    labels.emplace_back(info.label_inst[i], i);
-  std::sort(labels.begin(), labels.end());
-
-  std::vector<bool> used;
-  used.resize(num_labels);
-  for (size_t i = 0; i < lines.size(); ++i)
-    lines[i]->mark_label_used(used);
-
-  std::vector<size_t> rules;
-  rules.resize(num_labels, ~0ul);
+/* Renumbers the used labels in order, merging labels sharing a line. */
+void AsmFile::relabel(void)
+{
+  std::vector<bool> used(num_labels, false);
+  for (const auto &line : lines)
+  {
+    unsigned int label;
+    AsmFlow flow = line->get_flow(label);
+    if (flow == AsmFlow::Jump || flow == AsmFlow::Branch)
+      used[label] = true;
+  }
 
-  size_t last_line = ~0ul;
+  std::vector<size_t> rules(num_labels, ~0ul);
   size_t last_label = ~0ul;
-  for (size_t i = 0; i < labels.size(); ++i)
+  bool merging = false;
+  for (const auto &line : lines)
   {
-    if (!used[labels[i].second])
+    unsigned int label;
+    if (line->get_flow(label) != AsmFlow::Label) {
+      merging = false;
       continue;
-    if (last_line != labels[i].first) {
-      last_line = labels[i].first;
+    }
+    if (!used[label])
+      continue;
+
+    if (merging) {
+      /* Only the first of the labels sharing a line is emitted. */
+      used[label] = false;
+    } else {
       ++last_label;
+      merging = true;
     }
-    rules[labels[i].second] = last_label;
+    rules[label] = last_label;
   }
 
   std::vector<std::unique_ptr<AsmLine>> newlines;
@@ -0,0 +1,271 @@
+#include <vector>
+#include <algorithm>
+#include "asm.h"
+
+/* Longest run of instructions scheduled as a single region. */
+#define SCHEDULE_WINDOW  128
+
+/*
+ * Cycles until the result of an instruction of each unit can be used
+ * without stalling, for a single-issue in-order RV32 pipeline. Indexed
+ * by AsmUnit.
+ */
+static const unsigned int g_latencies[] = {
+  1,    /* Alu */
+  3,    /* Mul */
+  34,   /* Div */
+  3,    /* Load */
+  1,    /* Store */
+  1,    /* Barrier */
+};
+
+static unsigned int get_latency(AsmUnit unit)
+{
+  return g_latencies[static_cast<unsigned int>(unit)];
+}
+
+AsmUnit AsmLine::get_unit(void) const
+{
+  return AsmUnit::Barrier;
+}
+
+AsmUnit AsmBinaryInst::get_unit(void) const
+{
+  switch (op)
+  {
+  case AsmBinaryOp::Mul:
+    return AsmUnit::Mul;
+  case AsmBinaryOp::Div:
+  case AsmBinaryOp::Mod:
+    return AsmUnit::Div;
+  default:
+    return AsmUnit::Alu;
+  }
+}
+
+AsmUnit AsmBinaryImmInst::get_unit(void) const
+{
+  return AsmUnit::Alu;
+}
+
+AsmUnit AsmUnaryInst::get_unit(void) const
+{
+  return op == AsmUnaryOp::Jump ? AsmUnit::Barrier : AsmUnit::Alu;
+}
+
+AsmUnit AsmLoadImmInst::get_unit(void) const
+{
+  return AsmUnit::Alu;
+}
+
+AsmUnit AsmLoadAddrInst::get_unit(void) const
+{
+  return AsmUnit::Alu;
+}
+
+AsmUnit AsmMemoryInst::get_unit(void) const
+{
+  return op == AsmMemoryOp::Load ? AsmUnit::Load : AsmUnit::Store;
+}
+
+AsmUnit AsmSymMemoryInst::get_unit(void) const
+{
+  return op == AsmMemoryOp::Load ? AsmUnit::Load : AsmUnit::Store;
+}
+
+namespace {
+
+struct AsmSchedNode
+{
+  AsmUnit unit;
+  std::vector<std::pair<size_t, unsigned int>> succs;
+  unsigned int preds = 0;
+  unsigned int height = 0;
+  unsigned int earliest = 0;
+
+  /*
+   * Word accessed by a load or store, as a base register version or as
+   * an offset from a symbol.
+   */
+  const Symbol *sym = nullptr;
+  Register base = Register::UND;
+  unsigned int version = 0;
+  AsmImm off = 0;
+};
+
+}
+
+/* Whether two memory accesses may touch the same word. */
+static bool may_alias(const AsmSchedNode &a, const AsmSchedNode &b)
+{
+  if (a.sym && b.sym) {
+    if (!(*a.sym == *b.sym))
+      return false;
+  } else if (a.sym || b.sym || a.base != b.base || a.version != b.version) {
+    return true;
+  }
+  return a.off - b.off < 4 && b.off - a.off < 4;
+}
+
+/*
+ * Reorders lines[begin, end) by list scheduling over its dependence
+ * graph. Instructions are picked by the longest latency-weighted path to
+ * the end of the region, among those whose operands are already
+ * available; `exit` is the terminator whose operands close that path.
+ */
+static void schedule_region(std::vector<std::unique_ptr<AsmLine>> &lines,
+    size_t begin, size_t end, const AsmLine *exit)
+{
+  const size_t n = end - begin;
+  if (n < 2)
+    return;
+
+  std::vector<AsmSchedNode> nodes(n + 1);
+  auto add_edge = [&] (size_t from, size_t to, unsigned int latency) {
+    nodes[from].succs.emplace_back(to, latency);
+    ++nodes[to].preds;
+  };
+
+  const unsigned int nregs = static_cast<unsigned int>(Register::UND);
+  std::vector<size_t> last_def(nregs, ~0ul);
+  std::vector<std::vector<size_t>> readers(nregs);
+  std::vector<unsigned int> version(nregs, 0);
+  std::vector<size_t> memory;
+  size_t barrier = ~0ul;
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    const AsmLine *line = lines[begin + i].get();
+    AsmSchedNode &node = nodes[i];
+    node.unit = line->get_unit();
+
+    if (node.unit == AsmUnit::Barrier) {
+      for (size_t j = barrier + 1; j < i; ++j)
+        add_edge(j, i, 1);
+      barrier = i;
+    } else if (~barrier) {
+      add_edge(barrier, i, 1);
+    }
+
+    for (uint32_t uses = line->get_uses(); uses; uses &= uses - 1)
+    {
+      unsigned int reg = __builtin_ctz(uses);
+      if (~last_def[reg])
+        add_edge(last_def[reg], i, get_latency(nodes[last_def[reg]].unit));
+      readers[reg].emplace_back(i);
+    }
+
+    AsmMemoryOp op;
+    Register reg;
+    if (line->extract_if_memory(op, reg, node.base, node.off)
+        || line->extract_if_sym_memory(op, reg, node.sym, node.off)) {
+      if (!node.sym)
+        node.version = version[static_cast<unsigned int>(node.base)];
+      for (auto j : memory)
+        if ((node.unit == AsmUnit::Store || nodes[j].unit == AsmUnit::Store)
+            && may_alias(nodes[j], node))
+          add_edge(j, i, 1);
+      memory.emplace_back(i);
+    }
+
+    for (uint32_t defs = line->get_defs(); defs; defs &= defs - 1)
+    {
+      unsigned int reg = __builtin_ctz(defs);
+      for (auto j : readers[reg])
+        if (j != i)
+          add_edge(j, i, 0);
+      if (~last_def[reg])
+        add_edge(last_def[reg], i, 1);
+      readers[reg].clear();
+      last_def[reg] = i;
+      ++version[reg];
+    }
+  }
+
+  /* The terminator stays in place but waits for its operands. */
+  if (exit)
+    for (uint32_t uses = exit->get_uses(); uses; uses &= uses - 1)
+    {
+      unsigned int reg = __builtin_ctz(uses);
+      if (~last_def[reg])
+        add_edge(last_def[reg], n, get_latency(nodes[last_def[reg]].unit));
+    }
+
+  for (size_t i = n; i-- > 0;)
+    for (const auto &succ : nodes[i].succs)
+      nodes[i].height = std::max(nodes[i].height,
+          succ.second + nodes[succ.first].height);
+
+  std::vector<size_t> ready;
+  for (size_t i = 0; i < n; ++i)
+    if (nodes[i].preds == 0)
+      ready.emplace_back(i);
+
+  std::vector<std::unique_ptr<AsmLine>> order;
+  unsigned int cycle = 0;
+  while (!ready.empty())
+  {
+    /* Prefer an instruction that issues now, then the critical path. */
+    size_t best = 0;
+    for (size_t k = 1; k < ready.size(); ++k)
+    {
+      const AsmSchedNode &a = nodes[ready[k]], &b = nodes[ready[best]];
+      bool a_now = a.earliest <= cycle, b_now = b.earliest <= cycle;
+      if (a_now != b_now) {
+        if (a_now)
+          best = k;
+      } else if (!a_now && a.earliest != b.earliest) {
+        if (a.earliest < b.earliest)
+          best = k;
+      } else if (a.height != b.height) {
+        if (a.height > b.height)
+          best = k;
+      } else if (ready[k] < ready[best]) {
+        best = k;
+      }
+    }
+
+    size_t i = ready[best];
+    ready.erase(ready.begin() + best);
+    cycle = std::max(cycle, nodes[i].earliest);
+    for (const auto &succ : nodes[i].succs)
+    {
+      AsmSchedNode &next = nodes[succ.first];
+      next.earliest = std::max(next.earliest, cycle + succ.second);
+      if (--next.preds == 0 && succ.first < n)
+        ready.emplace_back(succ.first);
+    }
+    ++cycle;
+    order.emplace_back(std::move(lines[begin + i]));
+  }
+
+  assert(order.size() == n);
+  for (size_t i = 0; i < n; ++i)
+    lines[begin + i] = std::move(order[i]);
+}
+
+/*
+ * Schedules every straight-line run of instructions to hide the latency
+ * of loads, multiplications and divisions. Calls and other instructions
+ * with unknown effects keep their position relative to everything else.
+ */
+void AsmFile::schedule(void)
+{
+  const size_t n = lines.size();
+  size_t begin = 0;
+  while (begin < n)
+  {
+    unsigned int label;
+    size_t end = begin;
+    while (end < n && end - begin < SCHEDULE_WINDOW
+        && lines[end]->get_flow(label) == AsmFlow::Inst)
+      ++end;
+
+    const AsmLine *exit = nullptr;
+    if (end < n && lines[end]->get_flow(label) != AsmFlow::Inst)
+      exit = lines[end].get();
+    schedule_region(lines, begin, end, exit);
+
+    begin = end < n && exit ? end + 1 : end;
+  }
+}
@@ -1,7 +1,9 @@
 #pragma once
 #include <vector>
 #include <memory>
+#include <functional>
 #include "../lexer/symbol.h"
+#include "../utils/runs.h"
 #include "defid.h"
 
 enum class AstBinaryOp
@@ -42,6 +44,20 @@ class HirCompUnit;
 
 class AstContext;
 class AstType;
+class AstLvalExpr;
+class AstBlockStmt;
+
+/* An integer expression as a sum of scaled scalar variables. */
+struct AstAffine
+{
+  std::vector<std::pair<AstDefId, int>> terms;
+  int constant = 0;
+
+  void add_term(const AstDefId &var, int scale);
+  int get_term(const AstDefId &var) const;
+  int take_term(const AstDefId &var);
+  bool same_terms(const AstAffine &other) const;
+};
 
 class AstExpr
 {
@@ -53,6 +69,18 @@ public:
   virtual const AstType *type_check(AstContext *ctx) = 0;
 
   virtual std::unique_ptr<AstExpr> take_if_unary_not(void);
+  virtual bool extract_if_local_var(const AstContext *ctx, AstDefId &var);
+
+  virtual bool has_calls(void) const = 0;
+  virtual bool is_invariant(const AstDefId &var) const = 0;
+  virtual bool is_var(const AstDefId &var) const;
+  virtual bool is_literal(Literal value) const;
+  virtual bool is_step_of(const AstDefId &var) const;
+
+  virtual bool extract_affine(const AstContext *ctx,
+      AstAffine &form, int scale) const;
+  virtual void collect_elems(
+      std::vector<const AstLvalExpr *> &elems) const = 0;
 
   virtual std::unique_ptr<HirExpr> translate(AstContext *ctx) = 0;
 };
@@ -69,6 +97,14 @@ public:
   int const_eval(const AstContext *ctx) const override;
   const AstType *type_check(AstContext *ctx) override;
 
+  bool has_calls(void) const override;
+  bool is_invariant(const AstDefId &var) const override;
+  bool is_step_of(const AstDefId &var) const override;
+
+  bool extract_affine(const AstContext *ctx,
+      AstAffine &form, int scale) const override;
+  void collect_elems(std::vector<const AstLvalExpr *> &elems) const override;
+
   std::unique_ptr<HirExpr> translate(AstContext *ctx) override;
 
 protected:
@@ -90,6 +126,13 @@ public:
 
   std::unique_ptr<AstExpr> take_if_unary_not(void) override;
 
+  bool has_calls(void) const override;
+  bool is_invariant(const AstDefId &var) const override;
+
+  bool extract_affine(const AstContext *ctx,
+      AstAffine &form, int scale) const override;
+  void collect_elems(std::vector<const AstLvalExpr *> &elems) const override;
+
   std::unique_ptr<HirExpr> translate(AstContext *ctx) override;
 
 protected:
@@ -109,6 +152,24 @@ public:
   int const_eval(const AstContext *ctx) const override;
   const AstType *type_check(AstContext *ctx) override;
 
+  bool extract_if_local_var(const AstContext *ctx, AstDefId &var) override;
+
+  bool has_calls(void) const override;
+  bool is_invariant(const AstDefId &var) const override;
+  bool is_var(const AstDefId &var) const override;
+  bool is_indexed_by(const AstDefId &var) const;
+
+  bool extract_affine(const AstContext *ctx,
+      AstAffine &form, int scale) const override;
+  void collect_elems(std::vector<const AstLvalExpr *> &elems) const override;
+  bool extract_subscripts(const AstContext *ctx,
+      std::vector<AstAffine> &subs) const;
+
+  const AstDefId &get_ref(void) const
+  {
+    return ref;
+  }
+
   std::unique_ptr<HirExpr> into_addr(AstContext *ctx);
   std::unique_ptr<HirStmt>
   assigned_by(AstContext *ctx, std::unique_ptr<HirExpr> &&rhs);
@@ -133,6 +194,14 @@ public:
   int const_eval(const AstContext *ctx) const override;
   const AstType *type_check(AstContext *ctx) override;
 
+  bool has_calls(void) const override;
+  bool is_invariant(const AstDefId &var) const override;
+  bool is_literal(Literal value) const override;
+
+  bool extract_affine(const AstContext *ctx,
+      AstAffine &form, int scale) const override;
+  void collect_elems(std::vector<const AstLvalExpr *> &elems) const override;
+
   std::unique_ptr<HirExpr> translate(AstContext *ctx) override;
 
 protected:
@@ -151,6 +220,11 @@ public:
   int const_eval(const AstContext *ctx) const override;
   const AstType *type_check(AstContext *ctx) override;
 
+  bool has_calls(void) const override;
+  bool is_invariant(const AstDefId &var) const override;
+
+  void collect_elems(std::vector<const AstLvalExpr *> &elems) const override;
+
   std::unique_ptr<HirExpr> translate(AstContext *ctx) override;
 
 protected:
@@ -172,6 +246,9 @@ public:
   translate_into_cond(AstContext *ctx) = 0;
   virtual std::unique_ptr<HirExpr>
   translate_into_expr(AstContext *ctx) = 0;
+
+  virtual AstExpr *get_if_expr(void);
+  virtual bool extract_if_less(AstExpr *&lhs, AstExpr *&rhs);
 };
 
 class AstExprCond :public AstCond
@@ -189,6 +266,8 @@ public:
   std::unique_ptr<HirExpr>
   translate_into_expr(AstContext *ctx) override;
 
+  AstExpr *get_if_expr(void) override;
+
 protected:
   std::unique_ptr<AstExpr> expr;
 };
@@ -209,6 +288,8 @@ public:
   std::unique_ptr<HirExpr>
   translate_into_expr(AstContext *ctx) override;
 
+  bool extract_if_less(AstExpr *&lhs, AstExpr *&rhs) override;
+
 protected:
   std::unique_ptr<AstCond> lhs;
   std::unique_ptr<AstCond> rhs;
@@ -222,8 +303,8 @@ public:
     std::vector<std::pair<unsigned int, std::unique_ptr<AstExpr>>>
     ExprVector;
   typedef
-    std::vector<std::pair<unsigned int, int>>
-    LiteralVector;
+    std::function<void (unsigned int, std::unique_ptr<AstExpr> &&)>
+    ExprSink;
 
   AstInit(bool is_list)
     : is_list_(is_list)
@@ -237,8 +318,10 @@ public:
   virtual void name_resolve(AstContext *ctx) = 0;
   virtual void type_check(AstContext *ctx) = 0;
 
+  virtual AstExpr *get_if_expr(void);
+
   ExprVector collect(const std::vector<unsigned int> &shape);
-  LiteralVector collect_const(const AstContext *ctx,
+  DataRuns collect_const(const AstContext *ctx,
       const std::vector<unsigned int> &shape);
 
 protected:
@@ -246,13 +329,13 @@ protected:
     size_t position,
     const std::vector<unsigned int> &shape,
     size_t depth,
-    ExprVector &result,
+    const ExprSink &result,
     size_t base) = 0;
 
   virtual void do_collect_all(
     const std::vector<unsigned int> &shape,
     size_t depth,
-    ExprVector &result,
+    const ExprSink &result,
     size_t base) = 0;
 
 private:
@@ -271,18 +354,20 @@ public:
   void name_resolve(AstContext *ctx) override;
   void type_check(AstContext *ctx) override;
 
+  AstExpr *get_if_expr(void) override;
+
 protected:
   size_t do_collect(
     size_t position,
     const std::vector<unsigned int> &shape,
     size_t depth,
-    ExprVector &result,
+    const ExprSink &result,
     size_t base) override;
 
   void do_collect_all(
     const std::vector<unsigned int> &shape,
     size_t depth,
-    ExprVector &result,
+    const ExprSink &result,
     size_t base) override;
 
 protected:
@@ -304,13 +389,13 @@ protected:
     size_t position,
     const std::vector<unsigned int> &shape,
     size_t depth,
-    ExprVector &result,
+    const ExprSink &result,
     size_t base) override;
 
   void do_collect_all(
     const std::vector<unsigned int> &shape,
     size_t depth,
-    ExprVector &result,
+    const ExprSink &result,
     size_t base) override;
 
 protected:
@@ -326,6 +411,10 @@ public:
   virtual void type_check(AstContext *ctx) = 0;
 
   virtual void translate(AstContext *ctx, HirFuncBuilder *builder) = 0;
+
+  virtual bool extract_if_assign(AstLvalExpr *&lhs, AstExpr *&rhs);
+  virtual bool extract_if_scalar_decl(AstDefId &var, AstExpr *&init);
+  virtual bool extract_if_while(AstCond *&cond, AstBlockStmt *&body);
 };
 
 class AstExprStmt :public AstStmt
@@ -376,6 +465,8 @@ public:
 
   void translate(AstContext *ctx, HirFuncBuilder *builder) override;
 
+  bool extract_if_scalar_decl(AstDefId &var, AstExpr *&init) override;
+
 protected:
   bool is_const;
   std::vector<Symbol> sym;
@@ -398,6 +489,8 @@ public:
 
   void translate(AstContext *ctx, HirFuncBuilder *builder) override;
 
+  bool extract_if_assign(AstLvalExpr *&lhs, AstExpr *&rhs) override;
+
 protected:
   std::unique_ptr<AstLvalExpr> lhs;
   std::unique_ptr<AstExpr> rhs; 
@@ -417,6 +510,13 @@ public:
   translate_into_block(AstContext *ctx, HirFuncBuilder *builder);
   void translate(AstContext *ctx, HirFuncBuilder *builder) override;
 
+  bool extract_if_pair(AstStmt *&first, AstStmt *&second);
+
+  const std::vector<std::unique_ptr<AstStmt>> &get_stmts(void) const
+  {
+    return stmts;
+  }
+
 protected:
   std::vector<std::unique_ptr<AstStmt>> stmts;
 };
@@ -475,6 +575,12 @@ public:
 
   void translate(AstContext *ctx, HirFuncBuilder *builder) override;
 
+  bool extract_if_while(AstCond *&cond, AstBlockStmt *&body) override;
+
+private:
+  void translate_unrolled(AstContext *ctx, HirFuncBuilder *builder);
+  bool translate_interchanged(AstContext *ctx, HirFuncBuilder *builder);
+
 protected:
   std::unique_ptr<AstBlockStmt> body;
   std::unique_ptr<AstCond> cond;
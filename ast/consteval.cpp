@@ -98,31 +98,30 @@ AstInit::ExprVector
 AstInit::collect(const std::vector<unsigned int> &shape)
 {
   AstInit::ExprVector result;
-  do_collect_all(shape, 0, result, 0);
+  do_collect_all(shape, 0,
+      [&] (unsigned int index, std::unique_ptr<AstExpr> &&expr) {
+        result.emplace_back(index, std::move(expr));
+      }, 0);
   return result;
 }
 
-AstInit::LiteralVector
-AstInit::collect_const(const AstContext *ctx,
-                       const std::vector<unsigned int> &shape)
+/* Evaluates each element as it is reached, releasing its expression. */
+DataRuns AstInit::collect_const(const AstContext *ctx,
+                                const std::vector<unsigned int> &shape)
 {
-  auto expr = collect(shape);
-  AstInit::LiteralVector lit;
-
-  for (auto &e : expr)
-  {
-    int val = e.second->const_eval(ctx);
-    if (val != 0 || shape.size() == 0)
-      lit.emplace_back(e.first, val);
-  }
-
-  return lit;
+  DataRuns runs;
+  do_collect_all(shape, 0,
+      [&] (unsigned int index, std::unique_ptr<AstExpr> &&expr) {
+        runs.append(index, expr->const_eval(ctx));
+        expr.reset();
+      }, 0);
+  return runs;
 }
 
 void AstExprInit::do_collect_all(
     const std::vector<unsigned int> &shape,
     size_t depth,
-    std::vector<std::pair<unsigned int, std::unique_ptr<AstExpr>>> &result,
+    const ExprSink &result,
     size_t base)
 {
   if (depth != shape.size()) {
@@ -138,21 +137,21 @@ size_t AstExprInit::do_collect(
     size_t position,
     const std::vector<unsigned int> &shape,
     size_t depth,
-    std::vector<std::pair<unsigned int, std::unique_ptr<AstExpr>>> &result,
+    const ExprSink &result,
     size_t base)
 {
   assert(position == 0);
   assert(depth == shape.size());
   assert(expr != nullptr);
 
-  result.emplace_back(base, std::move(expr));
+  result(base, std::move(expr));
   return position + 1;
 }
 
 void AstListInit::do_collect_all(
     const std::vector<unsigned int> &shape,
     size_t depth,
-    std::vector<std::pair<unsigned int, std::unique_ptr<AstExpr>>> &result,
+    const ExprSink &result,
     size_t base)
 {
   if (shape.size() == depth) {
@@ -173,7 +172,7 @@ size_t AstListInit::do_collect(
     size_t position,
     const std::vector<unsigned int> &shape,
     size_t depth,
-    std::vector<std::pair<unsigned int, std::unique_ptr<AstExpr>>> &result,
+    const ExprSink &result,
     size_t base)
 {
   assert(depth <= shape.size() && position <= list.size());
@@ -95,6 +95,13 @@ public:
     return it->second;
   }
 
+  void def_rebind_localid(AstLocalDefId id, HirLocalId hirid)
+  {
+    auto it = locals.find(id);
+    assert(it != locals.end());
+    it->second = hirid;
+  }
+
   void def_set_symbol(AstLocalDefId id, Symbol symbol)
   {
     auto res = globals.emplace(id, symbol);
@@ -207,6 +214,11 @@ public:
     return scopes[id.scope].def_get_localid(id.id);
   }
 
+  void def_rebind_localid(AstDefId id, HirLocalId value)
+  {
+    scopes[id.scope].def_rebind_localid(id.id, value);
+  }
+
   void def_set_symbol(AstDefId id, Symbol value)
   {
     scopes[id.scope].def_set_symbol(id.id, value);
@@ -25,6 +25,11 @@ public:
     return scope == 0;
   }
 
+  bool operator ==(const AstDefId &other) const
+  {
+    return scope == other.scope && id == other.id;
+  }
+
 private:
   AstDefId(AstScopeId scope, AstLocalDefId id)
     : scope(scope), id(id)
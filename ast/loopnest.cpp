@@ -0,0 +1,470 @@
+#include <utility>
+#include "ast.h"
+#include "type.h"
+#include "context.h"
+#include "../hir/hir.h"
+#include "../hir/builder.h"
+
+/* Iterations of the inner loop run per tile when a nest is blocked. */
+#define LOOP_TILE_SIZE      32
+/* Fewest iterations of the outer loop for which a nest is blocked. */
+#define LOOP_TILE_MIN_ROWS  128
+
+void AstAffine::add_term(const AstDefId &var, int scale)
+{
+  for (auto &term : terms)
+    if (term.first == var) {
+      term.second += scale;
+      return;
+    }
+  terms.emplace_back(var, scale);
+}
+
+int AstAffine::get_term(const AstDefId &var) const
+{
+  for (const auto &term : terms)
+    if (term.first == var)
+      return term.second;
+  return 0;
+}
+
+int AstAffine::take_term(const AstDefId &var)
+{
+  for (auto it = terms.begin(); it != terms.end(); ++it)
+    if (it->first == var) {
+      int scale = it->second;
+      terms.erase(it);
+      return scale;
+    }
+  return 0;
+}
+
+/* Whether both forms differ by a constant only. */
+bool AstAffine::same_terms(const AstAffine &other) const
+{
+  for (const auto &term : terms)
+    if (other.get_term(term.first) != term.second)
+      return false;
+  for (const auto &term : other.terms)
+    if (get_term(term.first) != term.second)
+      return false;
+  return true;
+}
+
+/*
+ * Adds `scale` times the expression to `form`, if it is a linear
+ * combination of scalar variables.
+ */
+bool AstExpr::extract_affine(const AstContext *ctx,
+    AstAffine &form, int scale) const
+{
+  return false;
+}
+
+bool AstBinaryExpr::extract_affine(const AstContext *ctx,
+    AstAffine &form, int scale) const
+{
+  switch (op)
+  {
+  case AstBinaryOp::Add:
+    return lhs->extract_affine(ctx, form, scale)
+      && rhs->extract_affine(ctx, form, scale);
+  case AstBinaryOp::Sub:
+    return lhs->extract_affine(ctx, form, scale)
+      && rhs->extract_affine(ctx, form, -scale);
+  case AstBinaryOp::Mul:
+    for (int k = 0; k < 2; ++k)
+    {
+      const AstExpr *factor = k ? lhs.get() : rhs.get();
+      const AstExpr *other = k ? rhs.get() : lhs.get();
+      AstAffine value;
+      int product;
+      if (factor->extract_affine(ctx, value, 1) && value.terms.empty()
+          && !__builtin_mul_overflow(scale, value.constant, &product))
+        return other->extract_affine(ctx, form, product);
+    }
+    return false;
+  default:
+    return false;
+  }
+}
+
+bool AstUnaryExpr::extract_affine(const AstContext *ctx,
+    AstAffine &form, int scale) const
+{
+  switch (op)
+  {
+  case AstUnaryOp::Pos:
+    return expr->extract_affine(ctx, form, scale);
+  case AstUnaryOp::Neg:
+    return expr->extract_affine(ctx, form, -scale);
+  default:
+    return false;
+  }
+}
+
+bool AstLvalExpr::extract_affine(const AstContext *ctx,
+    AstAffine &form, int scale) const
+{
+  auto ty_base = ctx->def_get_type(ref);
+  if (!indices.empty() || ty_base->get_kind() != AstTypeKind::Int)
+    return false;
+  int product;
+  if (!static_cast<const AstIntType *>(ty_base)->is_const())
+    form.add_term(ref, scale);
+  else if (!__builtin_mul_overflow(scale, ctx->def_get_value(ref), &product))
+    form.constant += product;
+  else
+    return false;
+  return true;
+}
+
+bool AstLiteralExpr::extract_affine(const AstContext *ctx,
+    AstAffine &form, int scale) const
+{
+  int product;
+  if (__builtin_mul_overflow(scale, literal, &product))
+    return false;
+  form.constant += product;
+  return true;
+}
+
+/* Collects every array element read by the expression. */
+void AstBinaryExpr::collect_elems(
+    std::vector<const AstLvalExpr *> &elems) const
+{
+  lhs->collect_elems(elems);
+  rhs->collect_elems(elems);
+}
+
+void AstUnaryExpr::collect_elems(
+    std::vector<const AstLvalExpr *> &elems) const
+{
+  expr->collect_elems(elems);
+}
+
+void AstLvalExpr::collect_elems(
+    std::vector<const AstLvalExpr *> &elems) const
+{
+  if (!indices.empty())
+    elems.emplace_back(this);
+  for (const auto &index : indices)
+    index->collect_elems(elems);
+}
+
+void AstLiteralExpr::collect_elems(
+    std::vector<const AstLvalExpr *> &elems) const
+{ /* nothing */ }
+
+void AstCallExpr::collect_elems(
+    std::vector<const AstLvalExpr *> &elems) const
+{
+  for (const auto &arg : args)
+    arg->collect_elems(elems);
+}
+
+bool AstLvalExpr::extract_subscripts(const AstContext *ctx,
+    std::vector<AstAffine> &subs) const
+{
+  for (const auto &index : indices)
+  {
+    subs.emplace_back();
+    if (!index->extract_affine(ctx, subs.back(), 1))
+      return false;
+  }
+  return true;
+}
+
+namespace {
+
+/*
+ * An array element accessed in a loop nest. Each subscript is split into
+ * multiples of the outer and the inner loop variable and the rest.
+ */
+struct AstNestAccess
+{
+  AstDefId array;
+  AstTypeKind kind;
+  bool is_write;
+  std::vector<AstAffine> subs;
+  std::vector<int> outer;
+  std::vector<int> inner;
+};
+
+}
+
+/* Whether two accesses may reach the same memory through distinct arrays. */
+static bool may_alias(const AstNestAccess &a, const AstNestAccess &b)
+{
+  auto is_local = [] (const AstNestAccess &access) {
+    return access.kind == AstTypeKind::Array && !access.array.is_global();
+  };
+  return !is_local(a) && !is_local(b)
+    && (a.kind == AstTypeKind::Ptr || b.kind == AstTypeKind::Ptr);
+}
+
+/*
+ * Whether swapping the loops keeps the order of any two iterations in
+ * which `a` and `b` touch the same element, i.e. no such pair runs
+ * forwards in one loop and backwards in the other. Distances are solved
+ * from subscripts that use a single loop variable; anything else is
+ * assumed to depend in every direction.
+ */
+static bool is_interchangeable(const AstNestAccess &a, const AstNestAccess &b)
+{
+  bool outer_known = false, inner_known = false;
+  int outer_dist = 0, inner_dist = 0;
+  std::vector<size_t> coupled;
+
+  for (size_t k = 0; k < a.subs.size(); ++k)
+  {
+    if (a.outer[k] != b.outer[k] || a.inner[k] != b.inner[k]
+        || !a.subs[k].same_terms(b.subs[k]))
+      return false;
+
+    int diff = a.subs[k].constant - b.subs[k].constant;
+    if (a.outer[k] != 0 && a.inner[k] != 0) {
+      coupled.emplace_back(k);
+      continue;
+    } else if (a.outer[k] == 0 && a.inner[k] == 0) {
+      if (diff != 0)
+        return true;
+      continue;
+    }
+
+    bool is_outer = a.outer[k] != 0;
+    int scale = is_outer ? a.outer[k] : a.inner[k];
+    if (diff % scale != 0)
+      return true;
+    bool &known = is_outer ? outer_known : inner_known;
+    int &dist = is_outer ? outer_dist : inner_dist;
+    if (known && dist != diff / scale)
+      return true;
+    known = true;
+    dist = diff / scale;
+  }
+
+  for (auto k : coupled)
+  {
+    if (!outer_known || !inner_known)
+      return false;
+    int diff = a.subs[k].constant - b.subs[k].constant;
+    if (a.outer[k] * outer_dist + a.inner[k] * inner_dist != diff)
+      return true;
+  }
+
+  if (!outer_known && !inner_known)
+    return false;
+  if (!outer_known || !inner_known)
+    return (outer_known ? outer_dist : inner_dist) == 0;
+  return !(outer_dist > 0 && inner_dist < 0)
+    && !(outer_dist < 0 && inner_dist > 0);
+}
+
+/* Accesses walking across rows as the loop with the given coefficients runs. */
+static unsigned int count_strided(const std::vector<AstNestAccess> &accesses,
+    std::vector<int> AstNestAccess::*coeffs)
+{
+  unsigned int count = 0;
+  for (const auto &access : accesses)
+    for (size_t k = 0; k + 1 < access.subs.size(); ++k)
+      if ((access.*coeffs)[k] != 0) {
+        ++count;
+        break;
+      }
+  return count;
+}
+
+static bool is_const_at_least(const AstContext *ctx,
+    const AstExpr *expr, int value)
+{
+  AstAffine form;
+  return expr->extract_affine(ctx, form, 1) && form.terms.empty()
+    && form.constant >= value;
+}
+
+/*
+ * Perfect nests of the form
+ *
+ *   while (i < n) {
+ *     int j = j0;
+ *     while (j < m) { a[...] = expr; ...; j = j + 1; }
+ *     i = i + 1;
+ *   }
+ *
+ * whose inner loop walks some array across rows are swapped so that the
+ * inner loop runs along them. If some access still walks across rows and
+ * the nest is large, the inner loop is also strip-mined into tiles of
+ * LOOP_TILE_SIZE iterations, with the loop over tiles outermost. The
+ * bounds and `j0` may read neither loop variable nor any array element,
+ * and the body may only store to array elements at affine subscripts.
+ * Both changes reorder iterations exactly like a plain swap, so they are
+ * only made if no dependence between the accesses forbids that.
+ */
+bool AstWhileStmt::translate_interchanged(AstContext *ctx,
+    HirFuncBuilder *builder)
+{
+  AstExpr *index, *bound, *start, *inner_index, *inner_bound, *step;
+  AstCond *inner_cond;
+  AstBlockStmt *inner_body;
+  AstLvalExpr *lval;
+  AstDefId var, inner_var;
+  const auto &stmts = body->get_stmts();
+  if (!cond->extract_if_less(index, bound)
+      || !index->extract_if_local_var(ctx, var)
+      || !bound->is_invariant(var)
+      || stmts.size() != 3
+      || !stmts[0]->extract_if_scalar_decl(inner_var, start)
+      || !start->is_invariant(var) || !start->is_invariant(inner_var)
+      || !stmts[1]->extract_if_while(inner_cond, inner_body)
+      || !inner_cond->extract_if_less(inner_index, inner_bound)
+      || !inner_index->is_var(inner_var)
+      || !inner_bound->is_invariant(var)
+      || !inner_bound->is_invariant(inner_var)
+      || !stmts[2]->extract_if_assign(lval, step)
+      || !lval->is_var(var) || !step->is_step_of(var))
+    return false;
+
+  const auto &inner_stmts = inner_body->get_stmts();
+  if (inner_stmts.size() < 2
+      || !inner_stmts.back()->extract_if_assign(lval, step)
+      || !lval->is_var(inner_var) || !step->is_step_of(inner_var))
+    return false;
+
+  std::vector<AstNestAccess> accesses;
+  for (size_t i = 0; i + 1 < inner_stmts.size(); ++i)
+  {
+    AstExpr *value;
+    if (!inner_stmts[i]->extract_if_assign(lval, value)
+        || lval->has_calls() || value->has_calls())
+      return false;
+
+    /* The stored element comes first, followed by all reads. */
+    std::vector<const AstLvalExpr *> elems;
+    lval->collect_elems(elems);
+    value->collect_elems(elems);
+    for (size_t k = 0; k < elems.size(); ++k)
+    {
+      AstNestAccess access;
+      access.array = elems[k]->get_ref();
+      access.kind = ctx->def_get_type(access.array)->get_kind();
+      access.is_write = k == 0;
+      if (!elems[k]->extract_subscripts(ctx, access.subs)
+          || access.subs.empty())
+        return false;
+      for (auto &sub : access.subs)
+      {
+        access.outer.emplace_back(sub.take_term(var));
+        access.inner.emplace_back(sub.take_term(inner_var));
+      }
+      accesses.emplace_back(std::move(access));
+    }
+  }
+
+  for (const auto &a : accesses)
+    for (const auto &b : accesses)
+    {
+      if (!a.is_write)
+        continue;
+      if (!(a.array == b.array)) {
+        if (may_alias(a, b))
+          return false;
+      } else if (!is_interchangeable(a, b)) {
+        return false;
+      }
+    }
+
+  bool swap = count_strided(accesses, &AstNestAccess::outer)
+    < count_strided(accesses, &AstNestAccess::inner);
+  bool tile = count_strided(accesses,
+      swap ? &AstNestAccess::outer : &AstNestAccess::inner) > 0
+    && is_const_at_least(ctx, swap ? inner_bound : bound, LOOP_TILE_MIN_ROWS)
+    && is_const_at_least(ctx, swap ? bound : inner_bound, 2 * LOOP_TILE_SIZE);
+  if (!swap && !tile)
+    return false;
+
+  auto mk_var = [] (HirLocalId local) {
+    return std::make_unique<HirLocalVarExpr>(local);
+  };
+  auto mk_add = [&] (HirLocalId local, int value) {
+    return std::make_unique<HirBinaryExpr>(HirBinaryOp::Add,
+        mk_var(local), std::make_unique<HirLiteralExpr>(value));
+  };
+  auto mk_less = [] (std::unique_ptr<HirExpr> &&lhs,
+      std::unique_ptr<HirExpr> &&rhs) {
+    return std::make_unique<HirBinaryCond>(HirLogicalOp::Lt,
+        std::move(lhs), std::move(rhs));
+  };
+  auto add_assign = [&] (HirLocalId local, std::unique_ptr<HirExpr> &&expr) {
+    builder->add_statement(
+        std::make_unique<HirAssignStmt>(local, std::move(expr)));
+  };
+
+  builder->scope_push();
+  HirLocalId localid = ctx->def_get_localid(var);
+  HirLocalId from = builder->new_local();
+  add_assign(from, mk_var(localid));
+  HirLocalId inner_from = builder->new_local();
+  add_assign(inner_from, start->translate(ctx));
+  ctx->def_set_localid(inner_var, inner_from);
+
+  struct {
+    AstDefId var;
+    HirLocalId from;
+    AstExpr *bound;
+  } levels[2] = {{var, from, bound}, {inner_var, inner_from, inner_bound}};
+  if (swap)
+    std::swap(levels[0], levels[1]);
+  const auto &u = levels[0], &v = levels[1];
+
+  HirLocalId tile_from = v.from;
+  if (tile) {
+    tile_from = builder->new_local();
+    add_assign(tile_from, mk_var(v.from));
+    builder->scope_push();
+  }
+
+  HirLocalId u_local = builder->new_local();
+  add_assign(u_local, mk_var(u.from));
+  ctx->def_rebind_localid(u.var, u_local);
+  builder->scope_push();
+
+  HirLocalId v_local = builder->new_local();
+  add_assign(v_local, mk_var(tile_from));
+  ctx->def_rebind_localid(v.var, v_local);
+  builder->scope_push();
+  for (size_t i = 0; i + 1 < inner_stmts.size(); ++i)
+    inner_stmts[i]->translate(ctx, builder);
+  add_assign(v_local, mk_add(v_local, 1));
+  std::unique_ptr<HirCond> v_cond =
+    mk_less(mk_var(v_local), v.bound->translate(ctx));
+  if (tile)
+    v_cond = std::make_unique<HirShortcutCond>(HirShortcutOp::And,
+        std::move(v_cond),
+        mk_less(mk_var(v_local), mk_add(tile_from, LOOP_TILE_SIZE)));
+  builder->add_statement(std::make_unique<HirWhileStmt>(
+        std::move(v_cond), builder->scope_pop()));
+
+  add_assign(u_local, mk_add(u_local, 1));
+  builder->add_statement(std::make_unique<HirWhileStmt>(
+        mk_less(mk_var(u_local), u.bound->translate(ctx)),
+        builder->scope_pop()));
+
+  if (tile) {
+    add_assign(tile_from, mk_add(tile_from, LOOP_TILE_SIZE));
+    builder->add_statement(std::make_unique<HirWhileStmt>(
+          mk_less(mk_var(tile_from), v.bound->translate(ctx)),
+          builder->scope_pop()));
+  }
+
+  /* The outer variable leaves the original nest as max(i, n). */
+  ctx->def_rebind_localid(var, localid);
+  builder->scope_push();
+  add_assign(localid, bound->translate(ctx));
+  builder->add_statement(std::make_unique<HirIfStmt>(
+        mk_less(mk_var(localid), bound->translate(ctx)),
+        builder->scope_pop()));
+
+  builder->add_statement(builder->scope_pop());
+  return true;
+}
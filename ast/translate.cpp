@@ -4,6 +4,8 @@
 #include "../hir/hir.h"
 #include "../hir/builder.h"
 
+#define LOOP_UNROLL_FACTOR  8
+
 std::unique_ptr<AstExpr> AstExpr::take_if_unary_not(void)
 {
   return nullptr;
@@ -16,6 +18,116 @@ std::unique_ptr<AstExpr> AstUnaryExpr::take_if_unary_not(void)
   return nullptr;
 }
 
+bool AstExpr::extract_if_local_var(const AstContext *ctx, AstDefId &var)
+{
+  return false;
+}
+
+bool AstLvalExpr::extract_if_local_var(const AstContext *ctx, AstDefId &var)
+{
+  auto ty_base = ctx->def_get_type(ref);
+  if (!indices.empty() || ref.is_global()
+      || ty_base->get_kind() != AstTypeKind::Int
+      || static_cast<const AstIntType *>(ty_base)->is_const())
+    return false;
+  var = ref;
+  return true;
+}
+
+bool AstBinaryExpr::has_calls(void) const
+{
+  return lhs->has_calls() || rhs->has_calls();
+}
+
+bool AstUnaryExpr::has_calls(void) const
+{
+  return expr->has_calls();
+}
+
+bool AstLvalExpr::has_calls(void) const
+{
+  for (const auto &index : indices)
+    if (index->has_calls())
+      return true;
+  return false;
+}
+
+bool AstLiteralExpr::has_calls(void) const
+{
+  return false;
+}
+
+bool AstCallExpr::has_calls(void) const
+{
+  return true;
+}
+
+/*
+ * Whether the expression keeps its value while `var` and array elements
+ * are being written, i.e. reads neither of them and calls nothing.
+ */
+bool AstBinaryExpr::is_invariant(const AstDefId &var) const
+{
+  return lhs->is_invariant(var) && rhs->is_invariant(var);
+}
+
+bool AstUnaryExpr::is_invariant(const AstDefId &var) const
+{
+  return expr->is_invariant(var);
+}
+
+bool AstLvalExpr::is_invariant(const AstDefId &var) const
+{
+  return indices.empty() && !(ref == var);
+}
+
+bool AstLiteralExpr::is_invariant(const AstDefId &var) const
+{
+  return true;
+}
+
+bool AstCallExpr::is_invariant(const AstDefId &var) const
+{
+  return false;
+}
+
+bool AstExpr::is_var(const AstDefId &var) const
+{
+  return false;
+}
+
+bool AstLvalExpr::is_var(const AstDefId &var) const
+{
+  return indices.empty() && ref == var;
+}
+
+/* Whether this is an element access whose last index is `var`. */
+bool AstLvalExpr::is_indexed_by(const AstDefId &var) const
+{
+  return !indices.empty() && indices.back()->is_var(var);
+}
+
+bool AstExpr::is_literal(Literal value) const
+{
+  return false;
+}
+
+bool AstLiteralExpr::is_literal(Literal value) const
+{
+  return literal == value;
+}
+
+bool AstExpr::is_step_of(const AstDefId &var) const
+{
+  return false;
+}
+
+/* Whether this is `var + 1`. */
+bool AstBinaryExpr::is_step_of(const AstDefId &var) const
+{
+  return op == AstBinaryOp::Add && lhs->is_var(var) && rhs->is_literal(1);
+}
+
 std::unique_ptr<HirExpr> AstBinaryExpr::translate(AstContext *ctx)
 {
   HirBinaryOp hir_op;
@@ -230,6 +342,40 @@ AstExprCond::translate_into_expr(AstContext *ctx)
   return hir_expr;
 }
 
+AstExpr *AstInit::get_if_expr(void)
+{
+  return nullptr;
+}
+
+AstExpr *AstExprInit::get_if_expr(void)
+{
+  return expr.get();
+}
+
+AstExpr *AstCond::get_if_expr(void)
+{
+  return nullptr;
+}
+
+AstExpr *AstExprCond::get_if_expr(void)
+{
+  return expr.get();
+}
+
+bool AstCond::extract_if_less(AstExpr *&lhs, AstExpr *&rhs)
+{
+  return false;
+}
+
+bool AstBinaryCond::extract_if_less(AstExpr *&lhs, AstExpr *&rhs)
+{
+  if (op != AstLogicalOp::Lt)
+    return false;
+  lhs = this->lhs->get_if_expr();
+  rhs = this->rhs->get_if_expr();
+  return lhs && rhs;
+}
+
 std::unique_ptr<HirCond>
 AstBinaryCond::translate_into_cond(AstContext *ctx)
 {
@@ -338,15 +484,50 @@ void AstReturnStmt::translate(AstContext *ctx, HirFuncBuilder *builder)
       std::make_unique<HirReturnStmt>(std::move(hir_expr)));
 }
 
-static void fill_and_set(
-    AstContext *ctx,
+typedef std::vector<std::pair<unsigned int, std::unique_ptr<HirExpr>>>
+  HirInitVector;
+
+/* Stores `data` element by element, zeroing the elements it skips. */
+static void fill_while_setting(
     HirFuncBuilder *builder,
     HirArrayId arrayid,
+    unsigned int begin,
     unsigned int size,
-    AstInit::ExprVector &&data)
+    HirInitVector::iterator it,
+    HirInitVector::iterator end)
+{
+  for (unsigned int i = begin; i < size; ++i)
+  {
+    auto addr = std::make_unique<HirLocalAddrExpr>(arrayid, i * 4);
+    std::unique_ptr<HirExpr> expr;
+
+    if (it != end && it->first == i) {
+      expr = std::move(it->second);
+      ++it;
+    } else {
+      expr = std::make_unique<HirLiteralExpr>(0);
+    }
+
+    auto stmt =
+      std::make_unique<HirStoreStmt>(std::move(addr), std::move(expr));
+    builder->add_statement(std::move(stmt));
+  }
+}
+
+/*
+ * Emits a loop over the first (size & ~7) words of the array, storing
+ * eight words per iteration: zeros if `src` is null, or the words read
+ * from the same offsets of `src` otherwise.
+ */
+static void fill_by_loop(
+    HirFuncBuilder *builder,
+    HirArrayId arrayid,
+    unsigned int size,
+    const Symbol *src)
 {
   HirLocalId now = builder->new_local();
   HirLocalId end = builder->new_local();
+  HirLocalId from = src ? builder->new_local() : 0;
 
   builder->add_statement(
       std::make_unique<HirAssignStmt>(now,
@@ -356,6 +537,11 @@ static void fill_and_set(
         std::make_unique<HirBinaryExpr>(HirBinaryOp::Add,
           std::make_unique<HirLocalVarExpr>(now),
           std::make_unique<HirLiteralExpr>((size & ~7u) * 4))));
+  if (src) {
+    builder->add_statement(
+        std::make_unique<HirAssignStmt>(from,
+          std::make_unique<HirGlobalAddrExpr>(*src, 0)));
+  }
 
   auto cond = std::make_unique<HirBinaryCond>(
       HirLogicalOp::Lt,
@@ -363,14 +549,34 @@ static void fill_and_set(
       std::make_unique<HirLocalVarExpr>(end));
   std::vector<std::unique_ptr<HirStmt>> stmts;
 
+  /* The template never aliases the array, so all loads go first. */
+  HirLocalId values[8];
+  for (unsigned int i = 0; src && i < 8; ++i)
+  {
+    values[i] = builder->new_local();
+    stmts.emplace_back(
+        std::make_unique<HirAssignStmt>(values[i],
+          std::make_unique<HirUnaryExpr>(HirUnaryOp::Load,
+            std::make_unique<HirBinaryExpr>(
+              HirBinaryOp::Add,
+              std::make_unique<HirLocalVarExpr>(from),
+              std::make_unique<HirLiteralExpr>(i * 4)))));
+  }
+
   for (unsigned int i = 0; i < 8; ++i)
   {
+    std::unique_ptr<HirExpr> value;
+    if (src)
+      value = std::make_unique<HirLocalVarExpr>(values[i]);
+    else
+      value = std::make_unique<HirLiteralExpr>(0);
+
     auto stmt = std::make_unique<HirStoreStmt>(
         std::make_unique<HirBinaryExpr>(
           HirBinaryOp::Add,
           std::make_unique<HirLocalVarExpr>(now),
           std::make_unique<HirLiteralExpr>(i * 4)),
-        std::make_unique<HirLiteralExpr>(0));
+        std::move(value));
     stmts.emplace_back(std::move(stmt));
   }
   stmts.emplace_back(
@@ -379,65 +585,78 @@ static void fill_and_set(
           HirBinaryOp::Add,
           std::make_unique<HirLocalVarExpr>(now),
           std::make_unique<HirLiteralExpr>(8 * 4))));
+  if (src) {
+    stmts.emplace_back(
+        std::make_unique<HirAssignStmt>(from,
+          std::make_unique<HirBinaryExpr>(
+            HirBinaryOp::Add,
+            std::make_unique<HirLocalVarExpr>(from),
+            std::make_unique<HirLiteralExpr>(8 * 4))));
+  }
 
   builder->add_statement(
       std::make_unique<HirWhileStmt>(std::move(cond),
         std::make_unique<HirBlockStmt>(std::move(stmts))));
+}
+
+/*
+ * Zeroes the array with a loop, then stores the elements of `data` which
+ * are not literal zeros.
+ */
+static void fill_and_set(
+    HirFuncBuilder *builder,
+    HirArrayId arrayid,
+    unsigned int size,
+    HirInitVector &&data)
+{
+  fill_by_loop(builder, arrayid, size, nullptr);
 
   auto it = data.begin();
-  while (it != data.end() && it->first < (size & ~7u))
+  for (; it != data.end() && it->first < (size & ~7u); ++it)
   {
+    if (it->second->is_literal() && it->second->get_literal() == 0)
+      continue;
     auto addr = std::make_unique<HirLocalAddrExpr>(arrayid, it->first * 4);
-    auto expr = it->second->translate(ctx);
     auto stmt =
-      std::make_unique<HirStoreStmt>(std::move(addr), std::move(expr));
+      std::make_unique<HirStoreStmt>(std::move(addr), std::move(it->second));
     builder->add_statement(std::move(stmt));
-    ++it;
   }
 
-  for (unsigned int i = (size & ~7u); i < size; ++i)
-  {
-    auto addr = std::make_unique<HirLocalAddrExpr>(arrayid, i * 4);
-    std::unique_ptr<HirExpr> expr;
-
-    if (it != data.end() && it->first == i) {
-      expr = it->second->translate(ctx);
-      ++it;
-    } else {
-      expr = std::make_unique<HirLiteralExpr>(0);
-    }
-
-    auto stmt =
-      std::make_unique<HirStoreStmt>(std::move(addr), std::move(expr));
-    builder->add_statement(std::move(stmt));
-  }
+  fill_while_setting(builder, arrayid, size & ~7u, size, it, data.end());
 }
 
-static void fill_while_setting(
-    AstContext *ctx,
+/*
+ * Copies the literal elements of `data` from a read-only template named
+ * `symbol` with a loop, then stores the remaining elements.
+ */
+static void copy_and_set(
     HirFuncBuilder *builder,
     HirArrayId arrayid,
     unsigned int size,
-    AstInit::ExprVector &&data)
+    HirInitVector &&data,
+    Symbol symbol)
 {
-  auto it = data.begin();
+  DataRuns values;
+  for (const auto &elem : data)
+    if (elem.first < (size & ~7u) && elem.second->is_literal())
+      values.append(elem.first, elem.second->get_literal());
+  builder->add_item(std::make_unique<HirRodataItem>(
+        symbol, size & ~7u, std::move(values), true));
 
-  for (unsigned int i = 0; i < size; ++i)
-  {
-    auto addr = std::make_unique<HirLocalAddrExpr>(arrayid, i * 4);
-    std::unique_ptr<HirExpr> expr;
-
-    if (it != data.end() && it->first == i) {
-      expr = it->second->translate(ctx);
-      ++it;
-    } else {
-      expr = std::make_unique<HirLiteralExpr>(0);
-    }
+  fill_by_loop(builder, arrayid, size, &symbol);
 
+  auto it = data.begin();
+  for (; it != data.end() && it->first < (size & ~7u); ++it)
+  {
+    if (it->second->is_literal())
+      continue;
+    auto addr = std::make_unique<HirLocalAddrExpr>(arrayid, it->first * 4);
     auto stmt =
-      std::make_unique<HirStoreStmt>(std::move(addr), std::move(expr));
+      std::make_unique<HirStoreStmt>(std::move(addr), std::move(it->second));
     builder->add_statement(std::move(stmt));
   }
+
+  fill_while_setting(builder, arrayid, size & ~7u, size, it, data.end());
 }
 
 void AstDeclStmt::translate(AstContext *ctx, HirFuncBuilder *builder)
@@ -470,7 +689,7 @@ void AstDeclStmt::translate(AstContext *ctx, HirFuncBuilder *builder)
         auto symbol = def[i].make_unique_symbol();
         ctx->def_set_symbol(def[i], symbol);
         builder->add_item(std::make_unique<HirRodataItem>(
-              symbol, ty->num_elems(), std::move(collected)));
+              symbol, ty->num_elems(), std::move(collected), true));
       } else {
         HirArrayId arrayid = builder->new_array(ty->num_elems());
         ctx->def_set_arrayid(def[i], arrayid);
@@ -479,14 +698,33 @@ void AstDeclStmt::translate(AstContext *ctx, HirFuncBuilder *builder)
   
         auto collected = init[i]->collect(ty->get_shape());
         assert(collected.size() <= ty->num_elems());
-  
+
+        HirInitVector data;
+        unsigned int nr_literals = 0;
+        for (auto &elem : collected)
+        {
+          auto expr = elem.second->translate(ctx);
+          if (auto value = expr->const_eval())
+            expr = std::move(value);
+          if (expr->is_literal() && expr->get_literal() != 0)
+            ++nr_literals;
+          data.emplace_back(elem.first, std::move(expr));
+        }
+
+        /*
+         * Small arrays are stored element by element. Larger ones are
+         * zeroed by a loop if mostly zero, or copied from a template if
+         * they hold many literals.
+         */
         unsigned int size = ty->num_elems();
-        if (collected.size() < size / 2 && size > 16) {
-          fill_and_set(ctx, builder,
-              arrayid, size, std::move(collected));
+        if (size > 16 && nr_literals > 16 && nr_literals >= size / 4) {
+          copy_and_set(builder, arrayid, size, std::move(data),
+              def[i].make_unique_symbol());
+        } else if (collected.size() < size / 2 && size > 16) {
+          fill_and_set(builder, arrayid, size, std::move(data));
         } else {
-          fill_while_setting(ctx, builder,
-              arrayid, size, std::move(collected));
+          fill_while_setting(builder, arrayid, 0, size,
+              data.begin(), data.end());
         }
       }
     } else {
@@ -495,12 +733,60 @@ void AstDeclStmt::translate(AstContext *ctx, HirFuncBuilder *builder)
   }
 }
   
+bool AstStmt::extract_if_assign(AstLvalExpr *&lhs, AstExpr *&rhs)
+{
+  return false;
+}
+
+bool AstAssignStmt::extract_if_assign(AstLvalExpr *&lhs, AstExpr *&rhs)
+{
+  lhs = this->lhs.get();
+  rhs = this->rhs.get();
+  return true;
+}
+
+bool AstStmt::extract_if_scalar_decl(AstDefId &var, AstExpr *&init)
+{
+  return false;
+}
+
+/* Whether this declares a single variable with a scalar initializer. */
+bool AstDeclStmt::extract_if_scalar_decl(AstDefId &var, AstExpr *&init)
+{
+  if (is_const || sym.size() != 1 || !indices[0].empty() || !this->init[0])
+    return false;
+  var = def[0];
+  init = this->init[0]->get_if_expr();
+  return init != nullptr;
+}
+
+bool AstStmt::extract_if_while(AstCond *&cond, AstBlockStmt *&body)
+{
+  return false;
+}
+
+bool AstWhileStmt::extract_if_while(AstCond *&cond, AstBlockStmt *&body)
+{
+  cond = this->cond.get();
+  body = this->body.get();
+  return true;
+}
+
 void AstAssignStmt::translate(AstContext *ctx, HirFuncBuilder *builder)
 {
   auto hir_rhs = rhs->translate(ctx);
   builder->add_statement(lhs->assigned_by(ctx, std::move(hir_rhs)));
 }
 
+bool AstBlockStmt::extract_if_pair(AstStmt *&first, AstStmt *&second)
+{
+  if (stmts.size() != 2)
+    return false;
+  first = stmts[0].get();
+  second = stmts[1].get();
+  return true;
+}
+
 std::unique_ptr<HirBlockStmt>
 AstBlockStmt::translate_into_block(AstContext *ctx, HirFuncBuilder *builder)
 {
@@ -536,8 +822,69 @@ void AstIfElseStmt::translate(AstContext *ctx, HirFuncBuilder *builder)
         std::move(hir_cond), std::move(hir_if_stmt), std::move(hir_else_stmt)));
 }
 
+/*
+ * Fill and copy loops of the form
+ *
+ *   while (i < n) { a[...][i] = expr; i = i + 1; }
+ *
+ * get a copy of the body unrolled by LOOP_UNROLL_FACTOR in front of them,
+ * running while at least that many iterations are left. Each copy reads
+ * the index from its own local holding `i + k`, and `n` may not change
+ * while array elements are written, so the order of all stores and loads
+ * is kept as is.
+ */
+void AstWhileStmt::translate_unrolled(AstContext *ctx, HirFuncBuilder *builder)
+{
+  AstExpr *index, *bound, *value, *step;
+  AstStmt *store, *advance;
+  AstLvalExpr *elem, *var_lval;
+  AstDefId var;
+  if (!cond->extract_if_less(index, bound)
+      || !index->extract_if_local_var(ctx, var)
+      || !bound->is_invariant(var)
+      || !body->extract_if_pair(store, advance)
+      || !store->extract_if_assign(elem, value)
+      || !elem->is_indexed_by(var) || elem->has_calls() || value->has_calls()
+      || !advance->extract_if_assign(var_lval, step)
+      || !var_lval->is_var(var) || !step->is_step_of(var))
+    return;
+
+  HirLocalId localid = ctx->def_get_localid(var);
+  auto hir_cond = std::make_unique<HirBinaryCond>(HirLogicalOp::Lt,
+      std::make_unique<HirBinaryExpr>(HirBinaryOp::Add,
+        std::make_unique<HirLocalVarExpr>(localid),
+        std::make_unique<HirLiteralExpr>(LOOP_UNROLL_FACTOR - 1)),
+      bound->translate(ctx));
+
+  builder->scope_push();
+  for (unsigned int k = 0; k < LOOP_UNROLL_FACTOR; ++k)
+  {
+    HirLocalId now = builder->new_local();
+    builder->add_statement(
+        std::make_unique<HirAssignStmt>(now,
+          std::make_unique<HirBinaryExpr>(HirBinaryOp::Add,
+            std::make_unique<HirLocalVarExpr>(localid),
+            std::make_unique<HirLiteralExpr>(k))));
+    ctx->def_rebind_localid(var, now);
+    store->translate(ctx, builder);
+    ctx->def_rebind_localid(var, localid);
+  }
+  builder->add_statement(
+      std::make_unique<HirAssignStmt>(localid,
+        std::make_unique<HirBinaryExpr>(HirBinaryOp::Add,
+          std::make_unique<HirLocalVarExpr>(localid),
+          std::make_unique<HirLiteralExpr>(LOOP_UNROLL_FACTOR))));
+
+  builder->add_statement(std::make_unique<HirWhileStmt>(
+        std::move(hir_cond), builder->scope_pop()));
+}
+
 void AstWhileStmt::translate(AstContext *ctx, HirFuncBuilder *builder)
 {
+  if (translate_interchanged(ctx, builder))
+    return;
+  translate_unrolled(ctx, builder);
+
   auto hir_cond = cond->translate_into_cond(ctx);
   auto hir_body = body->translate_into_block(ctx, builder);
 
@@ -597,7 +944,6 @@ AstDeclItem::translate(AstContext *ctx, size_t i)
     if (init[i] != nullptr) {
       auto collected =
         init[i]->collect_const(ctx, std::vector<unsigned int>());
-      assert(collected.size() == 1 && collected[0].first == 0);
       return std::make_unique<HirDataItem>(sym[i], 1, std::move(collected));
     }
 
@@ -614,8 +960,9 @@ AstDeclItem::translate(AstContext *ctx, size_t i)
     auto collected = init[i]->collect_const(ctx, ty->get_shape());
 
     if (ty->is_const())
-      return std::make_unique<HirRodataItem>(sym[i], sz, std::move(collected));
-    else if (collected.size() == 0)
+      return std::make_unique<HirRodataItem>(
+          sym[i], sz, std::move(collected), false);
+    else if (collected.empty())
       return std::make_unique<HirBssItem>(sym[i], sz);
     else
       return std::make_unique<HirDataItem>(sym[i], sz, std::move(collected));
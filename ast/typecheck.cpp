@@ -210,8 +210,7 @@ void AstDeclStmt::type_check(AstContext *ctx)
       init[i]->type_check(ctx);
       auto values = init[i]->collect_const(
           ctx, std::vector<unsigned int>());
-      assert(values.size() == 1 && values[0].first == 0);
-      ctx->def_set_value(def[i], values[0].second);
+      ctx->def_set_value(def[i], values.at(0));
       continue;
     }
 
@@ -351,8 +350,7 @@ void AstDeclItem::type_check(AstContext *ctx)
       init[i]->type_check(ctx);
       auto values = init[i]->collect_const(
           ctx, std::vector<unsigned int>());
-      assert(values.size() == 1 && values[0].first == 0);
-      ctx->def_set_value(def[i], values[0].second);
+      ctx->def_set_value(def[i], values.at(0));
       continue;
     }
 
@@ -4,6 +4,7 @@
 #include "../lexer/symbol.h"
 #include "defid.h"
 #include "../mir/defid.h"
+#include "../utils/runs.h"
 
 enum class HirBinaryOp
 {
@@ -191,6 +192,10 @@ class HirCond
 public:
   virtual void translate(
       MirFuncBuilder *builder, MirLabel label_t, MirLabel label_f) = 0;
+  /* Unlike translate(), jumps to label_t if the condition holds and
+   * falls through to label_f (placed right after) otherwise. */
+  virtual void translate_jump(
+      MirFuncBuilder *builder, MirLabel label_t, MirLabel label_f) = 0;
 
   virtual std::unique_ptr<HirCond> const_eval(void);
 
@@ -205,6 +210,8 @@ public:
 
   void translate(MirFuncBuilder *builder,
       MirLabel label_t, MirLabel label_f) override;
+  void translate_jump(MirFuncBuilder *builder,
+      MirLabel label_t, MirLabel label_f) override;
 
   bool is_literal(void) const override;
   bool get_literal(void) const override;
@@ -217,6 +224,8 @@ public:
 
   void translate(MirFuncBuilder *builder,
       MirLabel label_t, MirLabel label_f) override;
+  void translate_jump(MirFuncBuilder *builder,
+      MirLabel label_t, MirLabel label_f) override;
 
   bool is_literal(void) const override;
   bool get_literal(void) const override;
@@ -232,6 +241,8 @@ public:
 
   void translate(MirFuncBuilder *builder,
       MirLabel label_t, MirLabel label_f) override;
+  void translate_jump(MirFuncBuilder *builder,
+      MirLabel label_t, MirLabel label_f) override;
 
   std::unique_ptr<HirCond> const_eval(void) override;
 
@@ -251,6 +262,8 @@ public:
 
   void translate(MirFuncBuilder *builder,
       MirLabel label_t, MirLabel label_f) override;
+  void translate_jump(MirFuncBuilder *builder,
+      MirLabel label_t, MirLabel label_f) override;
 
   std::unique_ptr<HirCond> const_eval(void) override;
 
@@ -454,7 +467,7 @@ class HirDataItem :public HirItem
 {
 public:
   HirDataItem(Symbol name, unsigned int size,
-      std::vector<std::pair<unsigned int, int>> &&values)
+      DataRuns &&values)
     : name(name), size(size), values(std::move(values))
   {}
 
@@ -463,15 +476,15 @@ public:
 private:
   Symbol name;
   unsigned int size;
-  std::vector<std::pair<unsigned int, int>> values;
+  DataRuns values;
 };
 
 class HirRodataItem :public HirItem
 {
 public:
   HirRodataItem(Symbol name, unsigned int size,
-      std::vector<std::pair<unsigned int, int>> &&values)
-    : name(name), size(size), values(std::move(values))
+      DataRuns &&values, bool local)
+    : name(name), size(size), values(std::move(values)), local(local)
   {}
 
   void translate(MirBuilder *builder) override;
@@ -479,7 +492,8 @@ public:
 private:
   Symbol name;
   unsigned int size;
-  std::vector<std::pair<unsigned int, int>> values;
+  DataRuns values;
+  bool local;
 };
 
 class HirBssItem :public HirItem
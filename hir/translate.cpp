@@ -180,6 +180,12 @@ void HirTrueCond::translate(
     MirFuncBuilder *builder, MirLabel label_t, MirLabel label_f)
 { /* nothing */ }
 
+void HirTrueCond::translate_jump(
+    MirFuncBuilder *builder, MirLabel label_t, MirLabel label_f)
+{
+  builder->add_statement(std::make_unique<MirJumpStmt>(label_t));
+}
+
 void HirFalseCond::translate(
     MirFuncBuilder *builder, MirLabel label_t, MirLabel label_f)
 {
@@ -187,6 +193,10 @@ void HirFalseCond::translate(
       std::make_unique<MirBranchStmt>(~0u, ~0u, label_f, MirLogicalOp::Eq));
 }
 
+void HirFalseCond::translate_jump(
+    MirFuncBuilder *builder, MirLabel label_t, MirLabel label_f)
+{ /* nothing */ }
+
 void HirBinaryCond::translate(
     MirFuncBuilder *builder, MirLabel label_t, MirLabel label_f)
 {
@@ -230,6 +240,49 @@ void HirBinaryCond::translate(
         mir_lhs, mir_rhs, label_f, mir_op));
 }
 
+void HirBinaryCond::translate_jump(
+    MirFuncBuilder *builder, MirLabel label_t, MirLabel label_f)
+{
+  MirLogicalOp mir_op;
+  bool swap;
+  switch (op)
+  {
+  case HirLogicalOp::Lt:
+    mir_op = MirLogicalOp::Lt;
+    swap = false;
+    break;
+  case HirLogicalOp::Leq:
+    mir_op = MirLogicalOp::Leq;
+    swap = false;
+    break;
+  case HirLogicalOp::Gt:
+    mir_op = MirLogicalOp::Lt;
+    swap = true;
+    break;
+  case HirLogicalOp::Geq:
+    mir_op = MirLogicalOp::Leq;
+    swap = true;
+    break;
+  case HirLogicalOp::Eq:
+    mir_op = MirLogicalOp::Eq;
+    swap = false;
+    break;
+  case HirLogicalOp::Ne:
+    mir_op = MirLogicalOp::Ne;
+    swap = false;
+    break;
+  }
+
+  MirLocal mir_lhs = lhs->translate(builder);
+  MirLocal mir_rhs = rhs->translate(builder);
+  if (swap)
+    std::swap(mir_lhs, mir_rhs);
+
+  builder->add_statement(
+      std::make_unique<MirBranchStmt>(
+        mir_lhs, mir_rhs, label_t, mir_op));
+}
+
 void HirShortcutCond::translate(
     MirFuncBuilder *builder, MirLabel label_t, MirLabel label_f)
 {
@@ -252,6 +305,26 @@ void HirShortcutCond::translate(
   }
 }
 
+void HirShortcutCond::translate_jump(
+    MirFuncBuilder *builder, MirLabel label_t, MirLabel label_f)
+{
+  MirLabel middle = builder->new_label();
+
+  switch (op)
+  {
+  case HirShortcutOp::And:
+    lhs->translate(builder, middle, label_f);
+    builder->set_label(middle);
+    rhs->translate_jump(builder, label_t, label_f);
+    break;
+  case HirShortcutOp::Or:
+    lhs->translate_jump(builder, label_t, middle);
+    builder->set_label(middle);
+    rhs->translate_jump(builder, label_t, label_f);
+    break;
+  }
+}
+
 void HirStoreStmt::translate(MirFuncBuilder *builder)
 {
   MirLocal addr = this->addr->translate(builder);
@@ -313,24 +386,32 @@ void HirIfElseStmt::translate(MirFuncBuilder *builder)
 
 void HirWhileStmt::translate(MirFuncBuilder *builder)
 {
-  MirLabel head = builder->new_label();
+  MirLabel guard = builder->new_label();
   MirLabel body = builder->new_label();
+  MirLabel test = builder->new_label();
   MirLabel branch_tail = builder->new_label();
   MirLabel jump_tail = builder->new_label();
+  MirLabel skip = builder->new_label();
 
-  builder->loop_push(head, jump_tail);
+  /* The loop is rotated: the test is duplicated as a guard in front of
+   * the loop and then done at the bottom, so that an iteration runs a
+   * single conditional branch instead of a branch and a jump. */
+  cond->translate(builder, guard, skip);
+  builder->set_label(guard);
 
-  builder->set_label(head);
-  cond->translate(builder, body, branch_tail);
+  builder->loop_push(test, jump_tail);
 
   builder->set_label(body);
   this->body->translate(builder);
 
-  builder->add_statement(std::make_unique<MirJumpStmt>(head));
+  builder->set_label(test);
+  cond->translate_jump(builder, body, branch_tail);
   builder->set_label(branch_tail);
   builder->set_label(jump_tail);
 
   builder->loop_pop();
+
+  builder->set_label(skip);
 }
 
 void HirExprStmt::translate(MirFuncBuilder *builder)
@@ -389,7 +470,8 @@ void HirDataItem::translate(MirBuilder *builder)
 void HirRodataItem::translate(MirBuilder *builder)
 {
   builder->add_item(
-      std::make_unique<MirRodataItem>(name, size, std::move(values)));
+      std::make_unique<MirRodataItem>(
+        name, size, std::move(values), local));
 }
 
 void HirBssItem::translate(MirBuilder *builder)
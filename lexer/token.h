@@ -153,6 +153,7 @@ private:
 
   friend class Lexer;
   friend class AstDefId;
+  friend class MirProfile;
 };
 
 extern inline std::ostream &operator <<(std::ostream &os, const Token &token)
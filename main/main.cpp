@@ -8,6 +8,7 @@
 #include "../ast/context.h"
 #include "../hir/hir.h"
 #include "../mir/mir.h"
+#include "../mir/options.h"
 #include "../asm/asm.h"
 
 [[ noreturn ]]
@@ -16,6 +17,11 @@ static void usage(const char *self)
   std::cerr << "usage: "
             << self
             << " [-S]"
+            << " [-O0 | -O1 | -O2 | -O3]"
+            << " [--passes=LIST]"
+            << " [-march=ISA]"
+            << " [-G SIZE]"
+            << " [-fprofile-generate[=FILE] | -fprofile-use[=FILE]]"
             << " INPUT"
             << " [-o]"
             << " [OUTPUT]"
@@ -28,12 +34,92 @@ int main(int argc, char **argv)
   std::ifstream is;
   std::ofstream ofs;
   std::streambuf *obuf;
+  MirOptions options;
   int i = 1;
 
-  if (i >= argc)
-    usage(argv[0]);
-  if (strcmp(argv[i], "-S") == 0)
-    ++i;
+  for (; i < argc && argv[i][0] == '-'; ++i)
+  {
+    if (strcmp(argv[i], "-S") == 0)
+      continue;
+
+    if (strncmp(argv[i], "-O", 2) == 0) {
+      const char *level = argv[i] + 2;
+      if (level[0] < '0' || level[0] > '3' || level[1] != '\0')
+        usage(argv[0]);
+      options.passes.set_level(level[0] - '0');
+      continue;
+    }
+
+    if (strncmp(argv[i], "--passes=", 9) == 0) {
+      if (!options.passes.set_passes(argv[i] + 9)) {
+        std::cerr << "error: "
+                  << options.passes.get_error()
+                  << std::endl;
+        abort();
+      }
+      continue;
+    }
+
+    if (strncmp(argv[i], "-march=", 7) == 0) {
+      if (!options.target.set_march(argv[i] + 7)) {
+        std::cerr << "error: "
+                  << options.target.get_error()
+                  << std::endl;
+        abort();
+      }
+      continue;
+    }
+
+    if (strncmp(argv[i], "-G", 2) == 0) {
+      const char *limit = argv[i] + 2;
+      if (*limit == '\0') {
+        if (++i >= argc)
+          usage(argv[0]);
+        limit = argv[i];
+      }
+      if (!options.target.set_small_data(limit)) {
+        std::cerr << "error: "
+                  << options.target.get_error()
+                  << std::endl;
+        abort();
+      }
+      continue;
+    }
+
+    if (strncmp(argv[i], "-fprofile-", 10) != 0)
+      usage(argv[0]);
+
+    const char *opt = argv[i] + 10;
+    const char *path = "sysy.prof";
+    MirProfileMode mode;
+
+    if (strncmp(opt, "generate", 8) == 0) {
+      mode = MirProfileMode::Generate;
+      opt += 8;
+    } else if (strncmp(opt, "use", 3) == 0) {
+      mode = MirProfileMode::Use;
+      opt += 3;
+    } else {
+      usage(argv[0]);
+    }
+
+    if (*opt == '=')
+      path = opt + 1;
+    else if (*opt != '\0')
+      usage(argv[0]);
+    if (options.profile)
+      usage(argv[0]);
+
+    options.profile = std::make_unique<MirProfile>(mode, path);
+    if (mode == MirProfileMode::Use && !options.profile->load()) {
+      std::cerr << "error: "
+                << "cannot read profile file `"
+                << path
+                << "`"
+                << std::endl;
+      abort();
+    }
+  }
 
   if (i >= argc)
     usage(argv[0]);
@@ -85,12 +171,17 @@ int main(int argc, char **argv)
   ast->type_check(&ctx);
 
   auto hir = ast->translate(&ctx);
-  hir->const_eval();
+  if (options.passes.has_pass("const-eval"))
+    hir->const_eval();
 
   auto mir = hir->translate();
 
-  auto asm_ = mir->codegen();
-  asm_->relabel();
+  auto asm_ = mir->codegen(&options);
+  asm_->optimize_branches();
+  if (options.passes.has_pass("peephole"))
+    asm_->peephole();
+  if (options.passes.has_pass("schedule"))
+    asm_->schedule();
   asm_->relabel();
 
   std::ostream(obuf) << *asm_;
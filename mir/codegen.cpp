@@ -1,5 +1,6 @@
 #include "mir.h"
 #include "context.h"
+#include "options.h"
 #include "../asm/asm.h"
 #include "../asm/builder.h"
 #include "../utils/bitset.h"
@@ -18,6 +19,21 @@ void MirSpillStore::codegen(const MirFuncContext *ctx) const
       AsmMemoryOp::Store, rs, Register::SP, off);
 }
 
+MirLocal MirSpillOp::get_slot(void) const
+{
+  return ~0u;
+}
+
+MirLocal MirSpillLoad::get_slot(void) const
+{
+  return var;
+}
+
+MirLocal MirSpillStore::get_slot(void) const
+{
+  return var;
+}
+
 void MirRematImm::codegen(const MirFuncContext *ctx) const
 {
   ctx->get_builder()->mk_load_imm_inst(rd, imm);
@@ -102,6 +118,16 @@ bool MirBranchStmt::maybe_jump(void) const
   return true;
 }
 
+bool MirStmt::is_jump(void) const
+{
+  return false;
+}
+
+bool MirJumpStmt::is_jump(void) const
+{
+  return true;
+}
+
 bool MirStmt::is_return(void) const
 {
   return false;
@@ -112,6 +138,16 @@ bool MirReturnStmt::is_return(void) const
   return true;
 }
 
+bool MirStmt::is_stack_addr(void) const
+{
+  return false;
+}
+
+bool MirArrayAddrStmt::is_stack_addr(void) const
+{
+  return true;
+}
+
 std::vector<unsigned int>
 MirStmt::get_next(const MirFuncContext *ctx, unsigned int id) const
 {
@@ -292,6 +328,39 @@ void MirBinaryStmt::codegen(
   case MirBinaryOp::Lt:
     instr = AsmBinaryOp::Lt;
     break;
+  case MirBinaryOp::And:
+    instr = AsmBinaryOp::And;
+    break;
+  case MirBinaryOp::Or:
+    instr = AsmBinaryOp::Or;
+    break;
+  case MirBinaryOp::Xor:
+    instr = AsmBinaryOp::Xor;
+    break;
+  case MirBinaryOp::Sh1Add:
+    instr = AsmBinaryOp::Sh1Add;
+    break;
+  case MirBinaryOp::Sh2Add:
+    instr = AsmBinaryOp::Sh2Add;
+    break;
+  case MirBinaryOp::Sh3Add:
+    instr = AsmBinaryOp::Sh3Add;
+    break;
+  case MirBinaryOp::Min:
+    instr = AsmBinaryOp::Min;
+    break;
+  case MirBinaryOp::Max:
+    instr = AsmBinaryOp::Max;
+    break;
+  case MirBinaryOp::Andn:
+    instr = AsmBinaryOp::Andn;
+    break;
+  case MirBinaryOp::CzeroEqz:
+    instr = AsmBinaryOp::CzeroEqz;
+    break;
+  case MirBinaryOp::CzeroNez:
+    instr = AsmBinaryOp::CzeroNez;
+    break;
   }
 
   ctx->get_builder()->mk_binary_inst(instr, rd, rs1, rs2);
@@ -432,24 +501,14 @@ void MirReturnStmt::codegen(
         AsmUnaryOp::Mv, Register::A0, rs);
   }
 
-  if (ctx->label_to_stmt_id(ctx->get_exit_label()) != id + 1) {
-    ctx->get_builder()->mk_jump_inst(ctx->get_exit_label());
-  }
+  /* Otherwise the exit is reached like a fall-through successor. */
+  Register ra = ctx->get_frameless_exit(id);
+  if (ra != Register::UND)
+    ctx->get_builder()->mk_jump_reg_inst(ra);
 }
 
-void MirFuncItem::codegen(AsmBuilder *builder)
+static void codegen_prologue(const MirFuncContext &ctx, AsmBuilder *builder)
 {
-  assert(num_args <= 9);
-
-  builder->mk_global_label(AsmLabelSec::Text, name);
-
-  MirFuncContext ctx(this, builder);
-  ctx.prepare();
-  ctx.optimize();
-  ctx.reg_alloc();
-
-  builder->alloc_labels(labels.size());
-
   size_t frame_size = ctx.get_frame_size();
   if (frame_size > 2048) {
     builder->mk_load_imm_inst(Register::T0, frame_size);
@@ -469,6 +528,102 @@ void MirFuncItem::codegen(AsmBuilder *builder)
         ctx.get_callee_reg_offset(i));
   }
 
+  for (const auto &move : ctx.get_prologue_moves())
+    builder->mk_unary_inst(AsmUnaryOp::Mv, move.first, move.second);
+}
+
+static void codegen_counter(AsmBuilder *builder,
+    Symbol counters, unsigned int index)
+{
+  builder->mk_binary_imm_inst(AsmBinaryImmOp::Add,
+      Register::SP, Register::SP, -8);
+  builder->mk_memory_inst(AsmMemoryOp::Store,
+      Register::T0, Register::SP, 0);
+  builder->mk_memory_inst(AsmMemoryOp::Store,
+      Register::T1, Register::SP, 4);
+
+  builder->mk_load_addr_inst(Register::T0, counters, index * sizeof(int));
+  builder->mk_memory_inst(AsmMemoryOp::Load,
+      Register::T1, Register::T0, 0);
+  builder->mk_binary_imm_inst(AsmBinaryImmOp::Add,
+      Register::T1, Register::T1, 1);
+  builder->mk_memory_inst(AsmMemoryOp::Store,
+      Register::T1, Register::T0, 0);
+
+  builder->mk_memory_inst(AsmMemoryOp::Load,
+      Register::T0, Register::SP, 0);
+  builder->mk_memory_inst(AsmMemoryOp::Load,
+      Register::T1, Register::SP, 4);
+  builder->mk_binary_imm_inst(AsmBinaryImmOp::Add,
+      Register::SP, Register::SP, 8);
+}
+
+static void codegen_epilogue(const MirFuncContext &ctx,
+    AsmBuilder *builder, unsigned int exit)
+{
+  size_t frame_size = ctx.get_frame_size();
+  unsigned int num_callee_regs = ctx.get_num_callee_regs();
+  for (unsigned int i = 0; i < num_callee_regs; ++i)
+  {
+    Register rs = reg_from_callee_id(i);
+    builder->mk_memory_inst(AsmMemoryOp::Load,
+        rs, Register::SP, ctx.get_callee_reg_offset(i));
+  }
+
+  Register ra = ctx.get_reg(std::make_pair(exit, 1u));
+
+  if (frame_size > 2047) {
+    builder->mk_load_imm_inst(Register::T0, frame_size);
+    builder->mk_binary_inst(AsmBinaryOp::Add,
+        Register::SP, Register::SP, Register::T0);
+  } else if (frame_size > 0) {
+    builder->mk_binary_imm_inst(AsmBinaryImmOp::Add,
+        Register::SP, Register::SP, frame_size);
+  }
+
+  builder->mk_jump_reg_inst(ra);
+}
+
+void MirFuncItem::codegen(AsmBuilder *builder, MirOptions *options)
+{
+  assert(num_args <= 9);
+
+  builder->mk_global_label(AsmLabelSec::Text, name);
+
+  MirFuncContext ctx(this, builder);
+  ctx.prepare();
+  ctx.optimize(options);
+
+  for (const auto &stmt : stmts)
+  {
+    const Symbol *sym;
+    off_t off;
+    if (stmt->extract_if_symbol_addr(sym, off))
+      options->used_symbols.insert(*sym);
+  }
+
+  MirProfile *profile = options->profile.get();
+  std::vector<unsigned int> blocks;
+  unsigned int counter_base = ~0u;
+  if (profile) {
+    blocks = ctx.calc_blocks();
+    if (profile->get_mode() == MirProfileMode::Generate)
+      counter_base = profile->add_func(name, stmts.size(), blocks);
+    else
+      ctx.set_block_counts(blocks,
+          profile->find_func(name, stmts.size(), blocks));
+  }
+
+  ctx.reg_alloc();
+
+  /* Blocks moved away from their MIR position may need a label of
+   * their own for the jump that replaces the fall-through. */
+  builder->alloc_labels(labels.size() + stmts.size());
+
+  unsigned int prologue_pos = ctx.get_prologue_pos();
+  if (prologue_pos == 0)
+    codegen_prologue(ctx, builder);
+
   for (const auto &store : ctx.get_spill_stores(0))
     store->codegen(&ctx);
 
@@ -484,106 +639,128 @@ void MirFuncItem::codegen(AsmBuilder *builder)
     sorted_labels.emplace_back(labels[i], i);
   std::sort(sorted_labels.begin(), sorted_labels.end());
 
-  Bitset reachable = ctx.calc_reachable();
+  auto codegen_stmt = [&] (unsigned int i) {
+    auto it = std::lower_bound(sorted_labels.begin(), sorted_labels.end(),
+        std::make_pair(i, (MirLabel) 0));
+    for (; it != sorted_labels.end() && it->first == i; ++it)
+      builder->mk_local_label(it->second);
 
-  auto it = sorted_labels.begin();
-  for (size_t i = 1; i < stmts.size(); ++i)
-  {
-    if (it != sorted_labels.end() && it->first == i) {
-      if (reachable.get(i))
-        builder->mk_local_label(it->second);
-      ++it;
-    }
-    if (!reachable.get(i))
-      continue;
+    auto block = std::lower_bound(blocks.begin(), blocks.end(), i);
+    if (~counter_base && block != blocks.end() && *block == i)
+      codegen_counter(builder, profile->get_counters(),
+          counter_base + (block - blocks.begin()));
+
+    if (i == prologue_pos)
+      codegen_prologue(ctx, builder);
 
     stmts[i]->codegen(&ctx, i);
     for (const auto &store : ctx.get_spill_stores(i))
       store->codegen(&ctx);
     for (const auto &load : ctx.get_spill_loads(i))
       load->codegen(&ctx);
-  }
 
-  for (unsigned int i = 0; i < num_callee_regs; ++i)
+    Register ra = ctx.get_frameless_exit(i);
+    if (ra != Register::UND && !stmts[i]->is_return())
+      builder->mk_jump_reg_inst(ra);
+  };
+
+  const unsigned int exit = stmts.size() - 1;
+  bool exit_emitted = false;
+  auto layout = ctx.calc_layout(options->passes.has_pass("block-layout"));
+  for (size_t i = 0; i < layout.size(); ++i)
   {
-    Register rs = reg_from_callee_id(i);
-    builder->mk_memory_inst(AsmMemoryOp::Load,
-        rs, Register::SP, ctx.get_callee_reg_offset(i));
+    const auto &block = layout[i];
+    builder->mk_local_label(labels.size() + block.start);
+    for (unsigned int pos = block.start; pos <= block.last; ++pos)
+      codegen_stmt(pos);
+
+    if (block.start == exit) {
+      codegen_epilogue(ctx, builder, exit);
+      exit_emitted = true;
+      continue;
+    }
+
+    unsigned int next = i + 1 < layout.size() ? layout[i + 1].start : ~0u;
+    if (block.fall == ~0u || block.fall == next)
+      continue;
+    auto it = std::lower_bound(sorted_labels.begin(), sorted_labels.end(),
+        std::make_pair(block.fall, (MirLabel) 0));
+    if (it != sorted_labels.end() && it->first == block.fall)
+      builder->mk_jump_inst(it->second);
+    else
+      builder->mk_jump_inst(labels.size() + block.fall);
   }
 
-  Register ra = ctx.get_reg(
-      std::make_pair((unsigned int) stmts.size() - 1, 1u));
+  if (!exit_emitted)
+    codegen_epilogue(ctx, builder, exit);
+}
 
-  if (frame_size > 2047) {
-    builder->mk_load_imm_inst(Register::T0, frame_size);
-    builder->mk_binary_inst(AsmBinaryOp::Add,
-        Register::SP, Register::SP, Register::T0);
-  } else if (frame_size > 0) {
-    builder->mk_binary_imm_inst(AsmBinaryImmOp::Add,
-        Register::SP, Register::SP, frame_size);
-  }
+void MirItem::prepare(MirOptions *options)
+{ /* nothing */ }
 
-  builder->mk_jump_reg_inst(ra);
+bool MirItem::is_func(void) const
+{
+  return false;
 }
 
-void MirDataItem::codegen(AsmBuilder *builder)
+bool MirFuncItem::is_func(void) const
 {
-  builder->mk_global_label(AsmLabelSec::Data, name);
+  return true;
+}
 
-  unsigned int now = 0;
-  for (const auto &value : values)
-  {
-    if (now != value.first) {
-      builder->mk_int_directive(
-          AsmIntDirType::Skip,
-          (value.first - now) * sizeof(int));
-    }
-    builder->mk_int_directive(
-        AsmIntDirType::Put, value.second);
-    now = value.first + 1;
-  }
-  if (now != size) {
-    builder->mk_int_directive(
-          AsmIntDirType::Skip,
-          (size - now) * sizeof(int));
-  }
+void MirRodataItem::prepare(MirOptions *options)
+{
+  options->rodata.emplace(name, this);
 }
 
-void MirRodataItem::codegen(AsmBuilder *builder)
+void MirDataItem::codegen(AsmBuilder *builder, MirOptions *options)
 {
-  builder->mk_global_label(AsmLabelSec::Rodata, name);
+  builder->mk_global_label(
+      options->target.is_small_data(size * sizeof(int))
+      ? AsmLabelSec::SData : AsmLabelSec::Data,
+      name);
+  builder->mk_data_directive(size, std::move(values));
+}
 
-  unsigned int now = 0;
-  for (const auto &value : values)
-  {
-    if (now != value.first) {
-      builder->mk_int_directive(
-          AsmIntDirType::Skip,
-          (value.first - now) * sizeof(int));
-    }
-    builder->mk_int_directive(
-        AsmIntDirType::Put, value.second);
-    now = value.first + 1;
-  }
-  if (now != size) {
-    builder->mk_int_directive(
-          AsmIntDirType::Skip,
-          (size - now) * sizeof(int));
-  }
+void MirRodataItem::codegen(AsmBuilder *builder, MirOptions *options)
+{
+  if (local && options->used_symbols.count(name) == 0)
+    return;
+
+  builder->mk_global_label(
+      options->target.is_small_data(size * sizeof(int))
+      ? AsmLabelSec::SRodata : AsmLabelSec::Rodata,
+      name);
+
+  /* Functions are generated first, so no lookup follows. */
+  builder->mk_data_directive(size, std::move(values));
 }
 
-void MirBssItem::codegen(AsmBuilder *builder)
+void MirBssItem::codegen(AsmBuilder *builder, MirOptions *options)
 {
-  builder->mk_global_label(AsmLabelSec::Bss, name);
+  builder->mk_global_label(
+      options->target.is_small_data(size * sizeof(int))
+      ? AsmLabelSec::SBss : AsmLabelSec::Bss,
+      name);
   builder->mk_int_directive(AsmIntDirType::Skip, size * sizeof(int));
 }
 
-std::unique_ptr<AsmFile> MirCompUnit::codegen(void)
+std::unique_ptr<AsmFile> MirCompUnit::codegen(MirOptions *options)
 {
   AsmBuilder builder;
 
   for (auto &item : items)
-    item->codegen(&builder);
+    item->prepare(options);
+
+  for (auto &item : items)
+    if (item->is_func())
+      item->codegen(&builder, options);
+  for (auto &item : items)
+    if (!item->is_func())
+      item->codegen(&builder, options);
+
+  if (options->profile)
+    options->profile->codegen(&builder);
 
   return std::make_unique<AsmFile>(std::move(builder));
 }
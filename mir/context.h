@@ -12,6 +12,18 @@
 typedef std::pair<unsigned int, unsigned int> MirOperand;
 typedef std::vector<MirOperand> MirOperands;
 
+struct MirBlock
+{
+  MirBlock(unsigned int start, unsigned int last, unsigned int fall)
+    : start(start), last(last), fall(fall)
+  {}
+
+  unsigned int start;
+  unsigned int last;
+  unsigned int fall;
+};
+
+struct MirCfgEdit;
 struct MirLocalLiveness;
 struct MirLoop;
 struct MirStmtInfo;
@@ -19,11 +31,20 @@ struct MirStmtInfo;
 class AsmBuilder;
 class Bitset;
 class MirFuncContext;
+struct MirOptions;
+
+enum class MirAnalysis
+{
+  StmtInfo,
+  Loops,
+  Idoms,
+};
 
 class MirSpillOp
 {
 public:
   virtual void codegen(const MirFuncContext *ctx) const = 0;
+  virtual MirLocal get_slot(void) const;
 };
 
 class MirSpillLoad :public MirSpillOp
@@ -34,6 +55,7 @@ public:
   {}
 
   void codegen(const MirFuncContext *ctx) const override;
+  MirLocal get_slot(void) const override;
 
 private:
   Register rd;
@@ -48,6 +70,7 @@ public:
   {}
 
   void codegen(const MirFuncContext *ctx) const override;
+  MirLocal get_slot(void) const override;
 
 private:
   Register rs;
@@ -112,10 +135,19 @@ public:
   ~MirFuncContext(void);
 
   void prepare(void);
-  void optimize(void);
+  void optimize(const MirOptions *options);
   void reg_alloc(void);
 
+  void require(MirAnalysis analysis);
+  void invalidate(void);
+
   Bitset calc_reachable(void);
+  const std::vector<unsigned int> &calc_idoms(void);
+  std::vector<unsigned int> calc_blocks(void);
+  std::vector<MirBlock> calc_layout(bool reorder);
+  void set_block_counts(const std::vector<unsigned int> &blocks,
+      const unsigned int *counts);
+  unsigned long estimate_freq(unsigned int stmt) const;
 
   unsigned int label_to_stmt_id(MirLabel label) const
   {
@@ -135,18 +167,18 @@ public:
   size_t get_frame_size(void) const
   {
     return sizeof(int) *
-      (func->array_size + num_callee_regs + spilled_locals.size());
+      (func->array_size + num_callee_regs + num_spill_slots);
   }
 
   off_t get_array_offset(MirArray vid) const
   {
     return sizeof(int) *
-      (func->array_offs[vid] + num_callee_regs + spilled_locals.size());
+      (func->array_offs[vid] + num_callee_regs + num_spill_slots);
   }
 
   off_t get_callee_reg_offset(unsigned int rid) const
   {
-    return sizeof(int) * (rid + spilled_locals.size());
+    return sizeof(int) * (rid + num_spill_slots);
   }
 
   off_t get_local_offset(MirLocal vid) const
@@ -177,6 +209,24 @@ public:
     return reg_info[operand.first][operand.second];
   }
 
+  unsigned int get_prologue_pos(void) const
+  {
+    return prologue_pos;
+  }
+
+  const std::vector<std::pair<Register, Register>> &
+  get_prologue_moves(void) const
+  {
+    return prologue_moves;
+  }
+
+  Register get_frameless_exit(unsigned int i) const
+  {
+    if (i < frameless_exits.size())
+      return frameless_exits[i];
+    return Register::UND;
+  }
+
   AsmBuilder *get_builder(void) const
   {
     return builder;
@@ -189,6 +239,8 @@ private:
   void spill_liveness_one(
       MirLocalLiveness &ll, std::vector<MirLocalLiveness> &buf);
   void spill_liveness_all(void);
+  void split_liveness_cross_func(void);
+  unsigned long estimate_spill_cost(const MirLocalLiveness &ll) const;
 
   bool graph_try_color(void);
   void finish_reg_alloc(void);
@@ -197,19 +249,49 @@ private:
   void fill_defs_and_uses(void);
 
   void finish_liveness(const MirLocalLiveness &ll, uint32_t color);
+  bool find_loops(std::vector<MirLoop> &loops);
+  bool check_loops(void);
   void identify_loops(void);
 
   Bitset identify_invariants(const MirLoop &loop);
   void move_invariants(void);
+  unsigned int find_unswitch_branch(const MirLoop &loop,
+      unsigned int budget, unsigned int &end, unsigned int &size) const;
+  bool unswitch_loop(unsigned int head, unsigned int end,
+      unsigned int branch);
+  void unswitch_loops(void);
 
   void convert_one_to_ssa(
       MirLocal local, PhiPosAndOps &phi_ops);
   void convert_all_to_ssa(void);
 
   void merge_duplicates(void);
+  void calc_constants(MirConstEnv &env) const;
+  void fold_constants(const MirOptions *options);
+  void remove_dead_code(void);
+  void simplify_cfg(const MirOptions *options);
+  bool thread_outcome(unsigned int pos, unsigned int start,
+      unsigned int branch, const MirConstEnv &env, bool &taken) const;
+  void thread_jumps(const MirOptions *options);
+  bool thread_jumps_once(const MirOptions *options);
+  void repair_phis(void);
+  void if_convert(const MirOptions *options);
+  bool if_convert_once(const MirOptions *options);
+  void combine_insts(const MirOptions *options);
+  void fold_addresses(void);
+  bool holds_same_value(MirLocal local, unsigned int from,
+      unsigned int pos) const;
   void remove_unused(void);
+  bool apply_cfg_edits(std::vector<MirCfgEdit> &edits);
+  void mark_unreachable(Bitset &removed_stmts);
+  void remove_stmts(const Bitset &removed_stmts);
+  std::vector<unsigned int> insert_stmts(
+      std::vector<std::pair<unsigned int, std::unique_ptr<MirStmt>>> &stmts);
+  void compute_idoms(void);
 
   void spill_regs_cross_func(void);
+  void color_spill_slots(void);
+  void shrink_wrap(void);
 
   MirLocal new_phi(void)
   {
@@ -223,12 +305,16 @@ private:
 
   std::vector<MirOperands> defs;
   std::vector<MirOperands> uses;
+  std::vector<unsigned long> stmt_counts;
 
   std::vector<MirLocalLiveness> liveness;
   std::vector<MirLoop> loops;
+  std::vector<unsigned int> idoms;
+  unsigned int valid_analyses;
 
   std::vector<std::vector<Register>> reg_info;
   std::unordered_map<MirLocal, unsigned int> spilled_locals;
+  unsigned int num_spill_slots;
   SpillPosAndOps spill_loads;
   SpillPosAndOps spill_stores;
 
@@ -236,6 +322,11 @@ private:
   mutable AsmBuilder *builder;
   unsigned int num_phis;
   bool tail_reachable;
+  bool leaf_func;
+
+  unsigned int prologue_pos;
+  std::vector<std::pair<Register, Register>> prologue_moves;
+  std::vector<Register> frameless_exits;
 
   static const SpillOps g_no_spill_ops;
 
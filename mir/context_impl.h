@@ -8,13 +8,14 @@ struct MirStmtInfo
       std::vector<unsigned int> &&prev,
       MirLocal def, bool func_call)
     : next(std::move(next)), prev(std::move(prev)),
-      def(def), func_call(func_call)
+      def(def), func_call(func_call), loop_depth(0)
   {}
 
   std::vector<unsigned int> next;
   std::vector<unsigned int> prev;
   MirLocal def;
   bool func_call;
+  unsigned int loop_depth;
 };
 
 struct MirLoop
@@ -30,3 +31,31 @@ struct MirLoop
   unsigned int head;
   std::vector<unsigned int> tails;
 };
+
+struct MirCfgEdit
+{
+  MirCfgEdit(unsigned int pos, std::unique_ptr<MirStmt> &&stmt)
+    : pos(pos), stmt(std::move(stmt)), target(~0u)
+  {}
+
+  MirCfgEdit(unsigned int pos, MirLabel target)
+    : pos(pos), stmt(), target(target)
+  {}
+
+  unsigned int pos;
+  std::unique_ptr<MirStmt> stmt;
+  MirLabel target;
+};
+
+struct MirConstEnv
+{
+  MirConstEnv(const std::unordered_map<Symbol, const MirRodataItem *> &rodata)
+    : values(), rodata(rodata)
+  {}
+
+  bool lookup(MirLocal local, MirConst &value) const;
+  bool load(MirConst addr, int &value) const;
+
+  std::unordered_map<MirLocal, MirConst> values;
+  const std::unordered_map<Symbol, const MirRodataItem *> &rodata;
+};
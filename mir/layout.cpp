@@ -0,0 +1,247 @@
+#include <algorithm>
+#include "mir.h"
+#include "context.h"
+#include "context_impl.h"
+#include "../utils/bitset.h"
+
+/* Ball-Larus heuristics, as the probability of taking the predicted edge. */
+static const double g_prob_loop_branch = 0.88;
+static const double g_prob_loop_header = 0.75;
+static const double g_prob_opcode = 0.84;
+static const double g_prob_return = 0.72;
+static const double g_prob_call = 0.78;
+
+/* Edges less likely than this lead to cold blocks. */
+static const double g_prob_cold = 0.3;
+
+static double combine_probs(double p, double q)
+{
+  double taken = p * q, not_taken = (1 - p) * (1 - q);
+  return taken / (taken + not_taken);
+}
+
+struct MirLayoutEdge
+{
+  MirLayoutEdge(unsigned int from, unsigned int to,
+      double prob, double weight)
+    : from(from), to(to), prob(prob), weight(weight)
+  {}
+
+  unsigned int from;
+  unsigned int to;
+  double prob;
+  double weight;
+};
+
+/*
+ * Splits the function into basic blocks and orders them for emission.
+ * Branch probabilities come from the profile if there is one, or else
+ * from static heuristics. Blocks are then merged into fall-through chains
+ * along the heaviest edges first (Pettis-Hansen), hot chains are placed
+ * after their heaviest predecessors, and chains only reached through
+ * unlikely edges go to the end. Without `reorder`, the blocks are
+ * returned in MIR order. The exit block is included if reachable.
+ */
+std::vector<MirBlock> MirFuncContext::calc_layout(bool reorder)
+{
+  require(MirAnalysis::Loops);
+  const unsigned int exit = stmt_info.size() - 1;
+  Bitset reachable = calc_reachable();
+
+  std::vector<MirBlock> blocks;
+  std::vector<unsigned int> block_of(stmt_info.size(), ~0u);
+  for (auto start : calc_blocks())
+  {
+    block_of[start] = blocks.size();
+    blocks.emplace_back(start, start, ~0u);
+  }
+  for (auto &block : blocks)
+  {
+    while (block.last + 1 < exit && block_of[block.last + 1] == ~0u
+        && reachable.get(block.last + 1))
+      ++block.last;
+
+    const auto &stmt = func->stmts[block.last];
+    if (get_frameless_exit(block.last) != Register::UND)
+      block.fall = ~0u;
+    else if (stmt->is_return())
+      block.fall = exit;
+    else if (!stmt->is_jump())
+      block.fall = block.last + 1;
+  }
+
+  const unsigned int exit_block = blocks.size();
+  if (reachable.get(exit))
+    blocks.emplace_back(exit, exit, ~0u);
+  if (!reorder || blocks.size() <= 2)
+    return blocks;
+
+  const unsigned int nr_blocks = blocks.size();
+
+  for (unsigned int i = 0; i < nr_blocks; ++i)
+    for (unsigned int pos = blocks[i].start; pos <= blocks[i].last; ++pos)
+      block_of[pos] = i;
+
+  std::vector<bool> enters_loop(nr_blocks, false);
+  for (size_t i = 1; i < loops.size(); ++i)
+    if (block_of[loops[i].head] != ~0u)
+      enters_loop[block_of[loops[i].head]] = true;
+
+  auto is_return = [&] (unsigned int block) {
+    unsigned int last = blocks[block].last;
+    const auto &next = stmt_info[last].next;
+    return func->stmts[last]->is_return()
+      || (next.size() == 1 && next[0] == exit);
+  };
+  auto has_call = [&] (unsigned int block) {
+    for (unsigned int pos = blocks[block].start;
+        pos <= blocks[block].last; ++pos)
+      if (stmt_info[pos].func_call)
+        return true;
+    return false;
+  };
+  auto block_count = [&] (unsigned int block) {
+    return (double) estimate_freq(blocks[block].start);
+  };
+
+  /* Probability that a branch at the end of `block` jumps to `taken`
+   * rather than falling through to `fall`. */
+  auto branch_prob = [&] (unsigned int block,
+      unsigned int taken, unsigned int fall) {
+    unsigned int last = blocks[block].last;
+    if (stmt_counts.size() != 0 && block_count(block) != 0) {
+      unsigned int start = blocks[taken].start;
+      if (start != exit && stmt_info[start].prev.size() == 1)
+        return std::min(block_count(taken) / block_count(block), 1.0);
+      start = blocks[fall].start;
+      if (start != exit && stmt_info[start].prev.size() == 1)
+        return 1 - std::min(block_count(fall) / block_count(block), 1.0);
+    }
+
+    double prob = 0.5;
+    unsigned int depth = stmt_info[last].loop_depth;
+    unsigned int taken_depth = stmt_info[blocks[taken].start].loop_depth;
+    unsigned int fall_depth = stmt_info[blocks[fall].start].loop_depth;
+    if (blocks[taken].start <= last)
+      prob = combine_probs(prob, g_prob_loop_branch);
+    else if (taken_depth < depth && fall_depth >= depth)
+      prob = combine_probs(prob, 1 - g_prob_loop_branch);
+    else if (fall_depth < depth && taken_depth >= depth)
+      prob = combine_probs(prob, g_prob_loop_branch);
+    else if (enters_loop[taken] != enters_loop[fall])
+      prob = combine_probs(prob, enters_loop[taken]
+          ? g_prob_loop_header : 1 - g_prob_loop_header);
+
+    MirLocal src1, src2;
+    MirLogicalOp op;
+    if (func->stmts[last]->extract_if_branch(src1, src2, op)
+        && (src1 == ~0u) != (src2 == ~0u)) {
+      /* Integers are rarely negative or zero. */
+      bool likely = op == MirLogicalOp::Ne
+        || (op != MirLogicalOp::Eq && src1 == ~0u);
+      prob = combine_probs(prob,
+          likely ? g_prob_opcode : 1 - g_prob_opcode);
+    }
+
+    if (is_return(taken) != is_return(fall))
+      prob = combine_probs(prob,
+          is_return(taken) ? 1 - g_prob_return : g_prob_return);
+    if (has_call(taken) != has_call(fall))
+      prob = combine_probs(prob,
+          has_call(taken) ? 1 - g_prob_call : g_prob_call);
+    return prob;
+  };
+
+  std::vector<MirLayoutEdge> edges;
+  for (unsigned int i = 0; i < exit_block; ++i)
+  {
+    if (get_frameless_exit(blocks[i].last) != Register::UND)
+      continue;
+
+    double count = block_count(i);
+    const auto &next = stmt_info[blocks[i].last].next;
+    if (next.size() == 1) {
+      edges.emplace_back(i, block_of[next[0]], 1.0, count);
+    } else if (next.size() == 2) {
+      unsigned int fall = block_of[blocks[i].fall];
+      unsigned int taken = block_of[next[0]] == fall
+        ? block_of[next[1]] : block_of[next[0]];
+      double prob = branch_prob(i, taken, fall);
+      edges.emplace_back(i, taken, prob, count * prob);
+      edges.emplace_back(i, fall, 1 - prob, count * (1 - prob));
+    }
+  }
+
+  std::stable_sort(edges.begin(), edges.end(),
+      [] (const MirLayoutEdge &a, const MirLayoutEdge &b) {
+        return a.weight > b.weight;
+      });
+
+  std::vector<std::vector<unsigned int>> chains(nr_blocks);
+  std::vector<unsigned int> chain_of(nr_blocks);
+  for (unsigned int i = 0; i < nr_blocks; ++i)
+  {
+    chains[i].emplace_back(i);
+    chain_of[i] = i;
+  }
+
+  for (const auto &edge : edges)
+  {
+    unsigned int from = chain_of[edge.from], to = chain_of[edge.to];
+    if (edge.to == 0 || from == to)
+      continue;
+    if (chains[from].back() != edge.from || chains[to].front() != edge.to)
+      continue;
+    for (auto block : chains[to])
+    {
+      chains[from].emplace_back(block);
+      chain_of[block] = from;
+    }
+    chains[to].clear();
+  }
+
+  std::vector<bool> hot(nr_blocks, false);
+  std::vector<double> heat(nr_blocks, 0);
+  std::vector<bool> placed(nr_blocks, false);
+  for (const auto &edge : edges)
+  {
+    bool cold = stmt_counts.size() != 0
+      ? edge.weight == 0 : edge.prob < g_prob_cold;
+    if (!cold && chain_of[edge.from] != chain_of[edge.to])
+      hot[chain_of[edge.to]] = true;
+  }
+
+  std::vector<unsigned int> order;
+  auto place = [&] (unsigned int chain) {
+    placed[chain] = true;
+    order.emplace_back(chain);
+    for (const auto &edge : edges)
+      if (chain_of[edge.from] == chain)
+        heat[chain_of[edge.to]] += edge.weight;
+  };
+
+  place(chain_of[0]);
+  for (;;)
+  {
+    unsigned int best = ~0u;
+    for (unsigned int i = 0; i < nr_blocks; ++i)
+    {
+      if (chains[i].empty() || placed[i] || !hot[i])
+        continue;
+      if (best == ~0u || heat[i] > heat[best])
+        best = i;
+    }
+    if (best == ~0u)
+      break;
+    place(best);
+  }
+  for (unsigned int i = 0; i < nr_blocks; ++i)
+    if (!chains[i].empty() && !placed[i])
+      place(i);
+
+  std::vector<MirBlock> layout;
+  for (auto chain : order)
+    for (auto block : chains[chain])
+      layout.emplace_back(blocks[block]);
+  return layout;
+}
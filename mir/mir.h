@@ -4,6 +4,7 @@
 #include <utility>
 #include "defid.h"
 #include "../lexer/symbol.h"
+#include "../utils/runs.h"
 
 enum class MirBinaryOp
 {
@@ -13,6 +14,17 @@ enum class MirBinaryOp
   Div,
   Mod,
   Lt,
+  And,
+  Or,
+  Xor,
+  Sh1Add,
+  Sh2Add,
+  Sh3Add,
+  Min,
+  Max,
+  Andn,
+  CzeroEqz,
+  CzeroNez,
 };
 
 enum class MirImmOp
@@ -49,6 +61,14 @@ class AsmFile;
 class AsmBuilder;
 
 class MirSpillOp;
+struct MirOptions;
+struct MirConstEnv;
+
+struct MirConst
+{
+  const Symbol *sym;
+  int value;
+};
 
 class MirStmt
 {
@@ -62,16 +82,38 @@ public:
   virtual bool is_func_call(void) const;
   virtual bool is_mem_load(void) const;
   virtual bool maybe_jump(void) const;
+  virtual bool is_jump(void) const;
   virtual bool maybe_mem_store(void) const;
   virtual bool is_return(void) const;
+  virtual bool is_stack_addr(void) const;
 
   virtual bool extract_if_assign(std::pair<MirLocal, MirLocal> &eq) const;
+  virtual bool extract_if_branch(
+      MirLocal &src1, MirLocal &src2, MirLogicalOp &op) const;
+  virtual bool extract_if_symbol_addr(
+      const Symbol *&name, off_t &offset) const;
+  virtual bool extract_if_array_addr(MirArray &id, off_t &offset) const;
+  virtual bool extract_if_mem_access(MirLocal &address, off_t &offset) const;
+  virtual bool extract_if_binary(
+      MirLocal &src1, MirLocal &src2, MirBinaryOp &op) const;
+  virtual bool extract_if_binary_imm(
+      MirLocal &src1, int &src2, MirImmOp &op) const;
+
+  virtual bool const_eval(const MirConstEnv &env, MirConst &result) const;
+  virtual std::unique_ptr<MirStmt> fold_branch(const MirConstEnv &env) const;
+
+  virtual MirLabel get_target(void) const;
+  virtual void set_target(MirLabel target);
+  virtual void set_offset(off_t offset);
 
   virtual bool can_rematerialize(void) const;
   virtual std::unique_ptr<MirSpillOp> rematerialize(Register rd) const;
+  virtual bool can_speculate(void) const;
 
   virtual bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) = 0;
+  virtual std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const = 0;
   virtual size_t hash(void) const;
   virtual bool equal(const MirStmt *other) const;
 
@@ -90,6 +132,8 @@ public:
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
   void replace(MirLocal local, MirLocal new_local) override;
 
   void codegen(const MirFuncContext *ctx, unsigned int id) const override;
@@ -106,11 +150,19 @@ public:
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
   size_t hash(void) const override;
   bool equal(const MirStmt *other) const override;
 
+  bool extract_if_symbol_addr(
+      const Symbol *&name, off_t &offset) const override;
+  bool const_eval(const MirConstEnv &env, MirConst &result) const override;
+  void set_offset(off_t offset) override;
+
   bool can_rematerialize(void) const override;
   std::unique_ptr<MirSpillOp> rematerialize(Register rd) const override;
+  bool can_speculate(void) const override;
 
   void codegen(const MirFuncContext *ctx, unsigned int id) const override;
 
@@ -129,15 +181,23 @@ public:
     : dest(dest), id(id), offset(offset)
   {}
 
+  bool is_stack_addr(void) const override;
+
   void replace(MirLocal local, MirLocal new_local) override;
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
   size_t hash(void) const override;
   bool equal(const MirStmt *other) const override;
 
+  bool extract_if_array_addr(MirArray &id, off_t &offset) const override;
+  void set_offset(off_t offset) override;
+
   bool can_rematerialize(void) const override;
   std::unique_ptr<MirSpillOp> rematerialize(Register rd) const override;
+  bool can_speculate(void) const override;
 
   void codegen(const MirFuncContext *ctx, unsigned int id) const override;
 
@@ -160,11 +220,15 @@ public:
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
   size_t hash(void) const override;
   bool equal(const MirStmt *other) const override;
+  bool const_eval(const MirConstEnv &env, MirConst &result) const override;
 
   bool can_rematerialize(void) const override;
   std::unique_ptr<MirSpillOp> rematerialize(Register rd) const override;
+  bool can_speculate(void) const override;
 
   void codegen(const MirFuncContext *ctx, unsigned int id) const override;
 
@@ -187,8 +251,14 @@ public:
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
   size_t hash(void) const override;
   bool equal(const MirStmt *other) const override;
+  bool extract_if_binary(
+      MirLocal &src1, MirLocal &src2, MirBinaryOp &op) const override;
+  bool const_eval(const MirConstEnv &env, MirConst &result) const override;
+  bool can_speculate(void) const override;
 
   void codegen(const MirFuncContext *ctx, unsigned int id) const override;
 
@@ -214,8 +284,14 @@ public:
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
   size_t hash(void) const override;
   bool equal(const MirStmt *other) const override;
+  bool extract_if_binary_imm(
+      MirLocal &src1, int &src2, MirImmOp &op) const override;
+  bool const_eval(const MirConstEnv &env, MirConst &result) const override;
+  bool can_speculate(void) const override;
 
   void codegen(const MirFuncContext *ctx, unsigned int id) const override;
 
@@ -242,8 +318,12 @@ public:
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
   size_t hash(void) const override;
   bool equal(const MirStmt *other) const override;
+  bool const_eval(const MirConstEnv &env, MirConst &result) const override;
+  bool can_speculate(void) const override;
 
   void codegen(const MirFuncContext *ctx, unsigned int id) const override;
 
@@ -266,6 +346,8 @@ public:
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
 
   bool is_func_call(void) const override;
   bool maybe_mem_store(void) const override;
@@ -294,6 +376,8 @@ public:
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
 
   void replace(MirLocal local, MirLocal new_local) override;
 
@@ -304,6 +388,14 @@ public:
 
   std::vector<MirLocal> get_uses(void) const override;
 
+  bool extract_if_branch(
+      MirLocal &src1, MirLocal &src2, MirLogicalOp &op) const override;
+  std::unique_ptr<MirStmt> fold_branch(
+      const MirConstEnv &env) const override;
+
+  MirLabel get_target(void) const override;
+  void set_target(MirLabel target) override;
+
   bool maybe_jump(void) const override;
 
 private:
@@ -322,6 +414,8 @@ public:
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
   void replace(MirLocal local, MirLocal new_local) override;
 
   std::vector<unsigned int>
@@ -330,6 +424,10 @@ public:
   void codegen(const MirFuncContext *ctx, unsigned int id) const override;
 
   bool maybe_jump(void) const override;
+  bool is_jump(void) const override;
+
+  MirLabel get_target(void) const override;
+  void set_target(MirLabel target) override;
 
 private:
   MirLabel target;
@@ -344,8 +442,14 @@ public:
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
   void replace(MirLocal local, MirLocal new_local) override;
 
+  bool extract_if_mem_access(
+      MirLocal &address, off_t &offset) const override;
+  void set_offset(off_t offset) override;
+
   void codegen(const MirFuncContext *ctx, unsigned int id) const override;
 
   std::vector<MirLocal> get_uses(void) const override;
@@ -369,8 +473,15 @@ public:
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
   size_t hash(void) const override;
   bool equal(const MirStmt *other) const override;
+  bool const_eval(const MirConstEnv &env, MirConst &result) const override;
+
+  bool extract_if_mem_access(
+      MirLocal &address, off_t &offset) const override;
+  void set_offset(off_t offset) override;
 
   void codegen(const MirFuncContext *ctx, unsigned int id) const override;
 
@@ -400,6 +511,8 @@ public:
 
   bool apply_rules(
     const std::unordered_map<MirLabel, MirLabel> &rules) override;
+  std::unique_ptr<MirStmt> clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const override;
   void replace(MirLocal local, MirLocal new_local) override;
 
   std::vector<unsigned int>
@@ -416,7 +529,9 @@ private:
 class MirItem
 {
 public:
-  virtual void codegen(AsmBuilder *builder) = 0;
+  virtual void prepare(MirOptions *options);
+  virtual bool is_func(void) const;
+  virtual void codegen(AsmBuilder *builder, MirOptions *options) = 0;
 };
 
 class MirFuncItem :public MirItem
@@ -424,7 +539,8 @@ class MirFuncItem :public MirItem
 public:
   MirFuncItem(MirFuncBuilder &&builder);
 
-  void codegen(AsmBuilder *builder) override;
+  bool is_func(void) const override;
+  void codegen(AsmBuilder *builder, MirOptions *options) override;
 
 private:
   Symbol name;
@@ -446,32 +562,36 @@ class MirDataItem :public MirItem
 {
 public:
   MirDataItem(Symbol name, unsigned int size,
-      std::vector<std::pair<unsigned int, int>> &&values)
+      DataRuns &&values)
     : name(name), size(size), values(std::move(values))
   {}
 
-  void codegen(AsmBuilder *builder) override;
+  void codegen(AsmBuilder *builder, MirOptions *options) override;
 
 private:
   Symbol name;
   unsigned int size;
-  std::vector<std::pair<unsigned int, int>> values;
+  DataRuns values;
 };
 
 class MirRodataItem :public MirItem
 {
 public:
   MirRodataItem(Symbol name, unsigned int size,
-      std::vector<std::pair<unsigned int, int>> &&values)
-    : name(name), size(size), values(std::move(values))
+      DataRuns &&values, bool local)
+    : name(name), size(size), values(std::move(values)), local(local)
   {}
 
-  void codegen(AsmBuilder *builder) override;
+  bool lookup(off_t offset, int &value) const;
+
+  void prepare(MirOptions *options) override;
+  void codegen(AsmBuilder *builder, MirOptions *options) override;
 
 private:
   Symbol name;
   unsigned int size;
-  std::vector<std::pair<unsigned int, int>> values;
+  DataRuns values;
+  bool local;
 };
 
 class MirBssItem :public MirItem
@@ -481,7 +601,7 @@ public:
     : name(name), size(size)
   {}
 
-  void codegen(AsmBuilder *builder) override;
+  void codegen(AsmBuilder *builder, MirOptions *options) override;
 
 private:
   Symbol name;
@@ -493,7 +613,7 @@ class MirCompUnit
 public:
   MirCompUnit(MirBuilder &&builder);
 
-  std::unique_ptr<AsmFile> codegen(void);
+  std::unique_ptr<AsmFile> codegen(MirOptions *options);
 
 private:
   std::vector<std::unique_ptr<MirItem>> items;
@@ -1,9 +1,15 @@
 #include <utility>
+#include <climits>
+#include <algorithm>
 #include <queue>
+#include <map>
 #include <stack>
+#include <functional>
+#include <unordered_map>
 #include "mir.h"
 #include "context.h"
 #include "context_impl.h"
+#include "options.h"
 #include "../utils/bitset.h"
 #include "../utils/hash.h"
 
@@ -213,6 +219,410 @@ bool MirLoadStmt::equal(const MirStmt *other) const
   return address == stmt->address && offset == stmt->offset;
 }
 
+bool MirStmt::extract_if_symbol_addr(
+    const Symbol *&name, off_t &offset) const
+{
+  return false;
+}
+
+bool MirSymbolAddrStmt::extract_if_symbol_addr(
+    const Symbol *&name, off_t &offset) const
+{
+  name = &this->name;
+  offset = this->offset;
+  return true;
+}
+
+bool MirStmt::extract_if_array_addr(MirArray &id, off_t &offset) const
+{
+  return false;
+}
+
+bool MirArrayAddrStmt::extract_if_array_addr(MirArray &id, off_t &offset) const
+{
+  id = this->id;
+  offset = this->offset;
+  return true;
+}
+
+bool MirStmt::extract_if_mem_access(MirLocal &address, off_t &offset) const
+{
+  return false;
+}
+
+bool MirStoreStmt::extract_if_mem_access(
+    MirLocal &address, off_t &offset) const
+{
+  address = this->address;
+  offset = this->offset;
+  return true;
+}
+
+bool MirLoadStmt::extract_if_mem_access(
+    MirLocal &address, off_t &offset) const
+{
+  address = this->address;
+  offset = this->offset;
+  return true;
+}
+
+bool MirConstEnv::lookup(MirLocal local, MirConst &value) const
+{
+  if (local == ~0u) {
+    value.sym = nullptr;
+    value.value = 0;
+    return true;
+  }
+
+  auto it = values.find(local);
+  if (it == values.end())
+    return false;
+  value = it->second;
+  return true;
+}
+
+bool MirConstEnv::load(MirConst addr, int &value) const
+{
+  if (addr.sym == nullptr)
+    return false;
+
+  auto it = rodata.find(*addr.sym);
+  if (it == rodata.end())
+    return false;
+  return it->second->lookup(addr.value, value);
+}
+
+bool MirRodataItem::lookup(off_t offset, int &value) const
+{
+  if (offset < 0 || offset % sizeof(int) != 0
+      || offset / sizeof(int) >= size)
+    return false;
+
+  value = values.at(offset / sizeof(int));
+  return true;
+}
+
+bool MirStmt::const_eval(const MirConstEnv &env, MirConst &result) const
+{
+  return false;
+}
+
+bool MirSymbolAddrStmt::const_eval(
+    const MirConstEnv &env, MirConst &result) const
+{
+  result.sym = &name;
+  result.value = offset;
+  return true;
+}
+
+bool MirImmStmt::const_eval(const MirConstEnv &env, MirConst &result) const
+{
+  result.sym = nullptr;
+  result.value = value;
+  return true;
+}
+
+bool MirBinaryStmt::const_eval(
+    const MirConstEnv &env, MirConst &result) const
+{
+  MirConst lhs, rhs;
+  if (!env.lookup(src1, lhs) || !env.lookup(src2, rhs))
+    return false;
+
+  unsigned int a = lhs.value, b = rhs.value;
+  result.sym = nullptr;
+  switch (op)
+  {
+  case MirBinaryOp::Add:
+    if (lhs.sym && rhs.sym)
+      return false;
+    result.sym = lhs.sym ? lhs.sym : rhs.sym;
+    result.value = a + b;
+    return true;
+  case MirBinaryOp::Sub:
+    if (rhs.sym)
+      return false;
+    result.sym = lhs.sym;
+    result.value = a - b;
+    return true;
+  case MirBinaryOp::Sh1Add:
+  case MirBinaryOp::Sh2Add:
+  case MirBinaryOp::Sh3Add:
+    if (lhs.sym)
+      return false;
+    result.sym = rhs.sym;
+    if (op == MirBinaryOp::Sh1Add)
+      result.value = (a << 1) + b;
+    else if (op == MirBinaryOp::Sh2Add)
+      result.value = (a << 2) + b;
+    else
+      result.value = (a << 3) + b;
+    return true;
+  default:
+    break;
+  }
+
+  if (lhs.sym || rhs.sym)
+    return false;
+
+  switch (op)
+  {
+  case MirBinaryOp::Mul:
+    result.value = a * b;
+    return true;
+  case MirBinaryOp::Div:
+  case MirBinaryOp::Mod:
+    if (rhs.value == 0 || (lhs.value == INT_MIN && rhs.value == -1))
+      return false;
+    if (op == MirBinaryOp::Div)
+      result.value = lhs.value / rhs.value;
+    else
+      result.value = lhs.value % rhs.value;
+    return true;
+  case MirBinaryOp::Lt:
+    result.value = lhs.value < rhs.value;
+    return true;
+  case MirBinaryOp::And:
+    result.value = a & b;
+    return true;
+  case MirBinaryOp::Or:
+    result.value = a | b;
+    return true;
+  case MirBinaryOp::Xor:
+    result.value = a ^ b;
+    return true;
+  case MirBinaryOp::Min:
+    result.value = std::min(lhs.value, rhs.value);
+    return true;
+  case MirBinaryOp::Max:
+    result.value = std::max(lhs.value, rhs.value);
+    return true;
+  case MirBinaryOp::Andn:
+    result.value = a & ~b;
+    return true;
+  case MirBinaryOp::CzeroEqz:
+    result.value = b == 0 ? 0 : a;
+    return true;
+  case MirBinaryOp::CzeroNez:
+    result.value = b != 0 ? 0 : a;
+    return true;
+  default:
+    break;
+  }
+
+  __builtin_unreachable();
+}
+
+bool MirBinaryImmStmt::const_eval(
+    const MirConstEnv &env, MirConst &result) const
+{
+  MirConst lhs;
+  if (!env.lookup(src1, lhs))
+    return false;
+
+  unsigned int a = lhs.value, b = src2;
+  result.sym = nullptr;
+  switch (op)
+  {
+  case MirImmOp::Add:
+    result.sym = lhs.sym;
+    result.value = a + b;
+    return true;
+  case MirImmOp::Mul:
+    if (lhs.sym)
+      return false;
+    result.value = a * b;
+    return true;
+  case MirImmOp::Lt:
+    if (lhs.sym)
+      return false;
+    result.value = lhs.value < src2;
+    return true;
+  }
+
+  __builtin_unreachable();
+}
+
+bool MirUnaryStmt::const_eval(
+    const MirConstEnv &env, MirConst &result) const
+{
+  MirConst value;
+  if (!env.lookup(src, value))
+    return false;
+
+  if (op == MirUnaryOp::Nop) {
+    result = value;
+    return true;
+  }
+  if (value.sym)
+    return false;
+
+  result.sym = nullptr;
+  switch (op)
+  {
+  case MirUnaryOp::Neg:
+    result.value = -(unsigned int) value.value;
+    return true;
+  case MirUnaryOp::Eqz:
+    result.value = value.value == 0;
+    return true;
+  case MirUnaryOp::Nez:
+    result.value = value.value != 0;
+    return true;
+  default:
+    break;
+  }
+
+  __builtin_unreachable();
+}
+
+bool MirLoadStmt::const_eval(const MirConstEnv &env, MirConst &result) const
+{
+  MirConst addr;
+  if (!env.lookup(address, addr))
+    return false;
+
+  addr.value += offset;
+  result.sym = nullptr;
+  return env.load(addr, result.value);
+}
+
+bool MirStmt::extract_if_branch(
+    MirLocal &src1, MirLocal &src2, MirLogicalOp &op) const
+{
+  return false;
+}
+
+bool MirBranchStmt::extract_if_branch(
+    MirLocal &src1, MirLocal &src2, MirLogicalOp &op) const
+{
+  src1 = this->src1;
+  src2 = this->src2;
+  op = this->op;
+  return true;
+}
+
+bool MirStmt::extract_if_binary(
+    MirLocal &src1, MirLocal &src2, MirBinaryOp &op) const
+{
+  return false;
+}
+
+bool MirBinaryStmt::extract_if_binary(
+    MirLocal &src1, MirLocal &src2, MirBinaryOp &op) const
+{
+  src1 = this->src1;
+  src2 = this->src2;
+  op = this->op;
+  return true;
+}
+
+bool MirStmt::extract_if_binary_imm(
+    MirLocal &src1, int &src2, MirImmOp &op) const
+{
+  return false;
+}
+
+bool MirBinaryImmStmt::extract_if_binary_imm(
+    MirLocal &src1, int &src2, MirImmOp &op) const
+{
+  src1 = this->src1;
+  src2 = this->src2;
+  op = this->op;
+  return true;
+}
+
+std::unique_ptr<MirStmt> MirStmt::fold_branch(const MirConstEnv &env) const
+{
+  return nullptr;
+}
+
+std::unique_ptr<MirStmt> MirBranchStmt::fold_branch(
+    const MirConstEnv &env) const
+{
+  MirConst lhs, rhs;
+  if (!env.lookup(src1, lhs) || !env.lookup(src2, rhs))
+    return nullptr;
+  if (lhs.sym || rhs.sym)
+    return nullptr;
+
+  bool taken;
+  switch (op)
+  {
+  case MirLogicalOp::Lt:
+    taken = lhs.value < rhs.value;
+    break;
+  case MirLogicalOp::Leq:
+    taken = lhs.value <= rhs.value;
+    break;
+  case MirLogicalOp::Eq:
+    taken = lhs.value == rhs.value;
+    break;
+  case MirLogicalOp::Ne:
+    taken = lhs.value != rhs.value;
+    break;
+  }
+
+  if (taken)
+    return std::make_unique<MirJumpStmt>(target);
+  return std::make_unique<MirEmptyStmt>();
+}
+
+MirLabel MirStmt::get_target(void) const
+{
+  return ~0u;
+}
+
+MirLabel MirBranchStmt::get_target(void) const
+{
+  return target;
+}
+
+MirLabel MirJumpStmt::get_target(void) const
+{
+  return target;
+}
+
+void MirStmt::set_target(MirLabel target)
+{
+  abort();
+}
+
+void MirBranchStmt::set_target(MirLabel target)
+{
+  this->target = target;
+}
+
+void MirJumpStmt::set_target(MirLabel target)
+{
+  this->target = target;
+}
+
+void MirStmt::set_offset(off_t offset)
+{
+  abort();
+}
+
+void MirSymbolAddrStmt::set_offset(off_t offset)
+{
+  this->offset = offset;
+}
+
+void MirArrayAddrStmt::set_offset(off_t offset)
+{
+  this->offset = offset;
+}
+
+void MirStoreStmt::set_offset(off_t offset)
+{
+  this->offset = offset;
+}
+
+void MirLoadStmt::set_offset(off_t offset)
+{
+  this->offset = offset;
+}
+
 void MirEmptyStmt::replace(MirLocal local, MirLocal new_local)
 { /* nothing */ }
 
@@ -331,6 +741,111 @@ bool MirReturnStmt::apply_rules(
   return false;
 }
 
+std::unique_ptr<MirStmt> MirEmptyStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  return std::make_unique<MirEmptyStmt>(*this);
+}
+
+std::unique_ptr<MirStmt> MirSymbolAddrStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  auto stmt = std::make_unique<MirSymbolAddrStmt>(*this);
+  replace_if_possible(stmt->dest);
+  return stmt;
+}
+
+std::unique_ptr<MirStmt> MirArrayAddrStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  auto stmt = std::make_unique<MirArrayAddrStmt>(*this);
+  replace_if_possible(stmt->dest);
+  return stmt;
+}
+
+std::unique_ptr<MirStmt> MirImmStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  auto stmt = std::make_unique<MirImmStmt>(*this);
+  replace_if_possible(stmt->dest);
+  return stmt;
+}
+
+std::unique_ptr<MirStmt> MirBinaryStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  auto stmt = std::make_unique<MirBinaryStmt>(*this);
+  stmt->apply_rules(rules);
+  replace_if_possible(stmt->dest);
+  return stmt;
+}
+
+std::unique_ptr<MirStmt> MirBinaryImmStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  auto stmt = std::make_unique<MirBinaryImmStmt>(*this);
+  stmt->apply_rules(rules);
+  replace_if_possible(stmt->dest);
+  return stmt;
+}
+
+std::unique_ptr<MirStmt> MirUnaryStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  auto stmt = std::make_unique<MirUnaryStmt>(*this);
+  stmt->apply_rules(rules);
+  replace_if_possible(stmt->dest);
+  return stmt;
+}
+
+std::unique_ptr<MirStmt> MirCallStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  auto stmt = std::make_unique<MirCallStmt>(*this);
+  stmt->apply_rules(rules);
+  replace_if_possible(stmt->dest);
+  return stmt;
+}
+
+std::unique_ptr<MirStmt> MirBranchStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  auto stmt = std::make_unique<MirBranchStmt>(*this);
+  stmt->apply_rules(rules);
+  return stmt;
+}
+
+std::unique_ptr<MirStmt> MirJumpStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  return std::make_unique<MirJumpStmt>(*this);
+}
+
+std::unique_ptr<MirStmt> MirStoreStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  auto stmt = std::make_unique<MirStoreStmt>(*this);
+  stmt->apply_rules(rules);
+  return stmt;
+}
+
+std::unique_ptr<MirStmt> MirLoadStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  auto stmt = std::make_unique<MirLoadStmt>(*this);
+  stmt->apply_rules(rules);
+  replace_if_possible(stmt->dest);
+  return stmt;
+}
+
+std::unique_ptr<MirStmt> MirReturnStmt::clone(
+    const std::unordered_map<MirLocal, MirLocal> &rules) const
+{
+  auto stmt = std::make_unique<MirReturnStmt>(*this);
+  stmt->apply_rules(rules);
+  return stmt;
+}
+
 void MirStmt::remove_dest(void)
 {
   abort();
@@ -482,54 +997,274 @@ void MirFuncContext::move_invariants(void)
   func->stmts = std::move(stmts);
   func->labels = std::move(labels);
 
-  prepare();
+  invalidate();
 }
 
-void MirFuncContext::convert_one_to_ssa(
-    MirLocal local, MirFuncContext::PhiPosAndOps &phi_ops)
+static const unsigned int g_unswitch_max_stmts = 64;
+static const unsigned int g_unswitch_max_growth = 192;
+
+/*
+ * Finds a branch in `loop` whose operands the loop does not define. The
+ * body and the tails of the loop must be contiguous, so that they can be
+ * copied as a whole, and must hold at most `budget` statements. Returns
+ * the position of the branch, or ~0u; `end` is set to the position after
+ * the last tail and `size` to the number of statements to copy.
+ */
+unsigned int MirFuncContext::find_unswitch_branch(const MirLoop &loop,
+    unsigned int budget, unsigned int &end, unsigned int &size) const
 {
-  std::vector<unsigned int> degrees;
-  for (size_t i = 0; i < stmt_info.size(); ++i)
+  const unsigned int head = loop.head;
+  std::vector<unsigned int> tails = loop.tails;
+  std::sort(tails.begin(), tails.end());
+
+  unsigned int last = head;
+  for (auto stmt : loop.stmts)
+    if (stmt != head && !std::binary_search(tails.begin(), tails.end(), stmt))
+      last = stmt;
+  for (unsigned int pos = head + 1; pos <= last; ++pos)
+    if (!loop.stmts.get(pos)
+        || std::binary_search(tails.begin(), tails.end(), pos))
+      return ~0u;
+  for (size_t i = 0; i < tails.size(); ++i)
+    if (tails[i] != last + 1 + i)
+      return ~0u;
+  end = last + 1 + tails.size();
+
+  /* A label on the preheader would bypass the hoisted branch. */
+  for (auto pos : func->labels)
+    if (pos == head)
+      return ~0u;
+
+  size = 0;
+  for (unsigned int pos = head + 1; pos < end; ++pos)
+    size += !func->stmts[pos]->is_empty();
+  if (size > budget || size > g_unswitch_max_stmts)
+    return ~0u;
+
+  Bitset defined(func->num_temps), copied(func->num_temps);
+  for (auto stmt : loop.stmts)
   {
-    unsigned int degree = 0;
-    for (auto ppos : stmt_info[i].prev)
-      if (ppos < i)
-        ++degree;
-    degrees.emplace_back(degree);
+    MirLocal def = stmt_info[stmt].def;
+    if (def == ~0u)
+      continue;
+    defined.set(def);
+    if (def >= func->num_locals)
+      copied.set(def);
   }
 
-  std::vector<unsigned int> stmt_version;
-  stmt_version.resize(stmt_info.size(), ~0);
+  /* Temps of the copy are renamed, so none may be used after the loop. */
+  for (unsigned int pos = 0; pos < stmt_info.size(); ++pos)
+  {
+    if (pos > head && pos < end)
+      continue;
+    for (auto use : func->stmts[pos]->get_uses())
+      if (use != ~0u && copied.get(use))
+        return ~0u;
+  }
 
-  std::queue<unsigned int> queue;
-  for (size_t i = stmt_info.size() - 1; ~i; --i)
+  for (unsigned int pos = head + 1; pos <= last; ++pos)
   {
-    if (degrees[i] != 0)
+    MirLocal src1, src2;
+    MirLogicalOp op;
+    if (!func->stmts[pos]->extract_if_branch(src1, src2, op)
+        || src1 == src2)
       continue;
-    stmt_version[i] = 0;
-    for (auto npos : stmt_info[i].next)
-      if (npos > i && --degrees[npos] == 0)
-        queue.push(npos);
+    if ((src1 != ~0u && defined.get(src1))
+        || (src2 != ~0u && defined.get(src2)))
+      continue;
+    unsigned int tpos = func->labels[func->stmts[pos]->get_target()];
+    if (tpos > head && tpos < end)
+      return pos;
   }
+  return ~0u;
+}
 
-  std::vector<MirLocal> version_local;
-  version_local.emplace_back(~0u);
+/*
+ * Replaces the loop in [head, end) with two copies selected by the branch
+ * at `branch`, which is hoisted in front of the preheader. The original
+ * loop runs when the branch is not taken and the copy, placed after it,
+ * when it is taken. Returns false if the result is not a valid loop
+ * structure, in which case nothing is changed.
+ */
+bool MirFuncContext::unswitch_loop(unsigned int head, unsigned int end,
+    unsigned int branch)
+{
+  const size_t nr_stmts = func->stmts.size();
+  const size_t saved_temps = func->num_temps;
+  const std::vector<size_t> saved_labels = func->labels;
 
-  if (local < func->num_args) {
-    stmt_version[0] = 1;
-    version_local.emplace_back(local);
+  MirLocal src1, src2;
+  MirLogicalOp op;
+  bool ok = func->stmts[branch]->extract_if_branch(src1, src2, op);
+  assert(ok);
+  MirLabel target = func->stmts[branch]->get_target();
+
+  assert(num_phis == func->num_temps);
+  std::unordered_map<MirLocal, MirLocal> rules;
+  for (unsigned int pos = head + 1; pos < end; ++pos)
+  {
+    MirLocal def = func->stmts[pos]->get_def();
+    if (def != ~0u && def >= func->num_locals && rules.count(def) == 0)
+      rules.emplace(def, func->num_temps++);
   }
+  num_phis = func->num_temps;
 
-  std::unordered_map<size_t, size_t> stmt_to_loop;
-  for (size_t i = 1; i < loops.size(); ++i)
-    stmt_to_loop[loops[i].head] = i;
+  const MirLabel old_exit = get_exit_label();
+  std::unordered_map<MirLabel, MirLabel> label_rules;
+  for (MirLabel label = 0; label < old_exit; ++label)
+    if (func->labels[label] > head && func->labels[label] < end)
+      label_rules.emplace(label, old_exit + label_rules.size());
+  const MirLabel copy_label = old_exit + label_rules.size();
+  const MirLabel merge_label = copy_label + 1;
 
-  while (!queue.empty())
+  func->labels.resize(func->labels.size() + label_rules.size() + 2);
+  for (auto &stmt : func->stmts)
+    if (stmt->get_target() == old_exit)
+      stmt->set_target(get_exit_label());
+
+  std::vector<std::unique_ptr<MirStmt>> stmts;
+  std::vector<unsigned int> new_pos(nr_stmts);
+  auto move_stmts = [&] (unsigned int first, unsigned int last) {
+    for (unsigned int pos = first; pos < last; ++pos)
+    {
+      new_pos[pos] = stmts.size();
+      stmts.emplace_back(std::move(func->stmts[pos]));
+    }
+  };
+
+  move_stmts(0, head);
+  stmts.emplace_back(
+      std::make_unique<MirBranchStmt>(src1, src2, copy_label, op));
+  move_stmts(head, end);
+  std::unique_ptr<MirStmt> saved_branch = std::move(stmts[new_pos[branch]]);
+  stmts[new_pos[branch]] = std::make_unique<MirEmptyStmt>();
+  stmts.emplace_back(std::make_unique<MirJumpStmt>(merge_label));
+
+  func->labels[copy_label] = stmts.size();
+  stmts.emplace_back(std::make_unique<MirEmptyStmt>());
+  for (unsigned int pos = head + 1; pos < end; ++pos)
   {
-    unsigned int pos = queue.front();
-    queue.pop();
+    std::unique_ptr<MirStmt> stmt;
+    if (pos == branch)
+      stmt = std::make_unique<MirJumpStmt>(target);
+    else
+      stmt = stmts[new_pos[pos]]->clone(rules);
+    if (auto it = label_rules.find(stmt->get_target());
+        it != label_rules.end())
+      stmt->set_target(it->second);
+    stmts.emplace_back(std::move(stmt));
+  }
+  func->labels[merge_label] = stmts.size();
+  stmts.emplace_back(std::make_unique<MirEmptyStmt>());
+  move_stmts(end, nr_stmts);
 
-    if (auto it = stmt_to_loop.find(pos);
+  for (MirLabel label = 0; label < old_exit; ++label)
+  {
+    unsigned int pos = saved_labels[label];
+    func->labels[label] = new_pos[pos];
+    if (auto it = label_rules.find(label); it != label_rules.end())
+      func->labels[it->second] =
+        func->labels[copy_label] + pos - head;
+  }
+  func->labels[get_exit_label()] = new_pos[saved_labels[old_exit]];
+  func->stmts = std::move(stmts);
+
+  if (check_loops())
+    return true;
+
+  stmts.clear();
+  for (unsigned int pos = 0; pos < nr_stmts; ++pos)
+    stmts.emplace_back(std::move(func->stmts[new_pos[pos]]));
+  stmts[branch] = std::move(saved_branch);
+  for (auto &stmt : stmts)
+    if (stmt->get_target() == get_exit_label())
+      stmt->set_target(old_exit);
+  func->stmts = std::move(stmts);
+  func->labels = saved_labels;
+  func->num_temps = saved_temps;
+  num_phis = saved_temps;
+  invalidate();
+  return false;
+}
+
+/*
+ * Moves branches on loop-invariant values out of loops by running a
+ * separate copy of the loop for each outcome. Outer loops are tried
+ * first; the copied statements are limited by g_unswitch_max_growth.
+ */
+void MirFuncContext::unswitch_loops(void)
+{
+  unsigned int budget = g_unswitch_max_growth;
+  bool changed = false;
+  while (true)
+  {
+    require(MirAnalysis::Loops);
+
+    unsigned int branch = ~0u, head, end, size;
+    for (size_t i = 1; i < loops.size() && branch == ~0u; ++i)
+    {
+      branch = find_unswitch_branch(loops[i], budget, end, size);
+      head = loops[i].head;
+    }
+    if (branch == ~0u)
+      break;
+
+    budget -= size;
+    changed |= unswitch_loop(head, end, branch);
+  }
+
+  if (changed) {
+    Bitset removed_stmts(func->stmts.size());
+    mark_unreachable(removed_stmts);
+    remove_stmts(removed_stmts);
+  }
+}
+
+void MirFuncContext::convert_one_to_ssa(
+    MirLocal local, MirFuncContext::PhiPosAndOps &phi_ops)
+{
+  std::vector<unsigned int> degrees;
+  for (size_t i = 0; i < stmt_info.size(); ++i)
+  {
+    unsigned int degree = 0;
+    for (auto ppos : stmt_info[i].prev)
+      if (ppos < i)
+        ++degree;
+    degrees.emplace_back(degree);
+  }
+
+  std::vector<unsigned int> stmt_version;
+  stmt_version.resize(stmt_info.size(), ~0);
+
+  std::queue<unsigned int> queue;
+  for (size_t i = stmt_info.size() - 1; ~i; --i)
+  {
+    if (degrees[i] != 0)
+      continue;
+    stmt_version[i] = 0;
+    for (auto npos : stmt_info[i].next)
+      if (npos > i && --degrees[npos] == 0)
+        queue.push(npos);
+  }
+
+  std::vector<MirLocal> version_local;
+  version_local.emplace_back(~0u);
+
+  if (local < func->num_args) {
+    stmt_version[0] = 1;
+    version_local.emplace_back(local);
+  }
+
+  std::unordered_map<size_t, size_t> stmt_to_loop;
+  for (size_t i = 1; i < loops.size(); ++i)
+    stmt_to_loop[loops[i].head] = i;
+
+  while (!queue.empty())
+  {
+    unsigned int pos = queue.front();
+    queue.pop();
+
+    if (auto it = stmt_to_loop.find(pos);
         it != stmt_to_loop.end()) {
       const auto &loop = loops[it->second];
       bool found = false;
@@ -599,7 +1334,12 @@ void MirFuncContext::convert_one_to_ssa(
       if (npos < pos) {
         unsigned int newv = stmt_version[npos];
         unsigned int ver = stmt_version[pos];
-        assert(newv != ~0u && ver != ~0u);
+        /* A rotated loop whose body never falls through keeps its
+         * bottom test, which is unreachable and may be visited before
+         * the body. */
+        if (newv == ~0u)
+          continue;
+        assert(ver != ~0u);
         if (newv != ver) {
           phi_ops[pos].emplace_back(
               version_local[newv], version_local[ver]);
@@ -688,7 +1428,7 @@ void MirFuncContext::convert_all_to_ssa(void)
   func->stmts = std::move(stmts);
   func->labels = std::move(labels);
 
-  prepare();
+  invalidate();
 }
 
 void MirFuncContext::merge_duplicates(void)
@@ -939,6 +1679,11 @@ void MirFuncContext::remove_unused(void)
       removed_stmts.set(i);
   }
 
+  remove_stmts(removed_stmts);
+}
+
+void MirFuncContext::remove_stmts(const Bitset &removed_stmts)
+{
   std::vector<std::unique_ptr<MirStmt>> stmts;
   std::vector<size_t> labels;
   labels.resize(func->labels.size());
@@ -969,15 +1714,152 @@ void MirFuncContext::remove_unused(void)
   func->stmts = std::move(stmts);
   func->labels = std::move(labels);
 
-  prepare();
+  invalidate();
+}
+
+/*
+ * Inserts each statement in front of the given position (and its label)
+ * and updates the position to the new one. Returns the new positions of
+ * the existing statements.
+ */
+std::vector<unsigned int> MirFuncContext::insert_stmts(
+    std::vector<std::pair<unsigned int, std::unique_ptr<MirStmt>>> &inserted)
+{
+  std::vector<size_t> order(inserted.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+      [&] (size_t lhs, size_t rhs) {
+        return inserted[lhs].first < inserted[rhs].first;
+      });
+
+  std::vector<std::unique_ptr<MirStmt>> stmts;
+  std::vector<size_t> labels;
+  labels.resize(func->labels.size());
+  std::vector<unsigned int> new_pos(func->stmts.size());
+
+  std::vector<std::pair<size_t, MirLabel>> sorted_labels;
+  for (unsigned int i = 0; i < func->labels.size(); ++i)
+    sorted_labels.emplace_back(func->labels[i], i);
+  std::sort(sorted_labels.begin(), sorted_labels.end());
+
+  size_t j = 0, k = 0;
+  for (size_t i = 0; i < func->stmts.size(); ++i)
+  {
+    for (; k < order.size() && inserted[order[k]].first == i; ++k)
+    {
+      auto &stmt = inserted[order[k]];
+      stmt.first = stmts.size();
+      stmts.emplace_back(std::move(stmt.second));
+    }
+
+    for (; j < sorted_labels.size() && sorted_labels[j].first == i; ++j)
+      labels[sorted_labels[j].second] = stmts.size();
+    new_pos[i] = stmts.size();
+    stmts.emplace_back(std::move(func->stmts[i]));
+  }
+  assert(j == sorted_labels.size() && k == order.size());
+
+  func->stmts = std::move(stmts);
+  func->labels = std::move(labels);
+
+  invalidate();
+  return new_pos;
+}
+
+void MirFuncContext::calc_constants(MirConstEnv &env) const
+{
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (size_t i = 0; i < func->stmts.size(); ++i)
+    {
+      MirLocal def = stmt_info[i].def;
+      if (def == ~0u || def < func->num_locals || stmt_info[i].func_call)
+        continue;
+      if (def >= func->num_temps)
+        continue;
+      if (env.values.count(def) != 0)
+        continue;
+
+      MirConst value;
+      if (func->stmts[i]->const_eval(env, value)) {
+        env.values.emplace(def, value);
+        changed = true;
+      }
+    }
+  }
+}
+
+void MirFuncContext::fold_constants(const MirOptions *options)
+{
+  MirConstEnv env(options->rodata);
+  calc_constants(env);
+
+  bool changed = false;
+  for (size_t i = 0; i < func->stmts.size(); ++i)
+  {
+    auto it = env.values.find(stmt_info[i].def);
+    if (it == env.values.end() || it->second.sym != nullptr)
+      continue;
+
+    auto &stmt = func->stmts[i];
+    std::pair<MirLocal, MirLocal> eq;
+    if (stmt->can_rematerialize() || stmt->extract_if_assign(eq))
+      continue;
+
+    if (it->second.value != 0)
+      stmt = std::make_unique<MirImmStmt>(it->first, it->second.value);
+    else
+      stmt = std::make_unique<MirUnaryStmt>(
+          it->first, ~0u, MirUnaryOp::Nop);
+    changed = true;
+  }
+
+  if (changed)
+    invalidate();
 }
 
-void MirFuncContext::optimize(void)
+void MirFuncContext::optimize(const MirOptions *options)
 {
-  move_invariants();
-  convert_all_to_ssa();
-  merge_duplicates();
-  remove_unused();
+  for (auto pass : options->passes.get_passes())
+  {
+    if (pass->kind == MirPassKind::Hir || pass->kind == MirPassKind::Emit)
+      continue;
+
+    require(MirAnalysis::Loops);
+
+    std::string name = pass->name;
+    if (name == "licm")
+      move_invariants();
+    else if (name == "unswitch")
+      unswitch_loops();
+    else if (name == "ssa")
+      convert_all_to_ssa();
+    else if (name == "cse")
+      merge_duplicates();
+    else if (name == "fold")
+      fold_constants(options);
+    else if (name == "adce")
+      remove_dead_code();
+    else if (name == "simplify-cfg")
+      simplify_cfg(options);
+    else if (name == "jump-threading")
+      thread_jumps(options);
+    else if (name == "if-convert")
+      if_convert(options);
+    else if (name == "combine")
+      combine_insts(options);
+    else if (name == "addr-fold")
+      fold_addresses();
+    else if (name == "dce")
+      remove_unused();
+    else
+      abort();
+  }
+
+  require(MirAnalysis::Loops);
 }
 
 Bitset MirFuncContext::calc_reachable(void)
@@ -1002,3 +1884,1553 @@ Bitset MirFuncContext::calc_reachable(void)
 
   return reachable;
 }
+
+const std::vector<unsigned int> &MirFuncContext::calc_idoms(void)
+{
+  require(MirAnalysis::Idoms);
+  return idoms;
+}
+
+static std::vector<unsigned int> calc_dominators(
+    const std::vector<MirStmtInfo> &stmt_info, unsigned int root, bool reverse)
+{
+  const size_t nr_stmts = stmt_info.size();
+  auto succs = [&] (unsigned int pos) -> const std::vector<unsigned int> & {
+    return reverse ? stmt_info[pos].prev : stmt_info[pos].next;
+  };
+  auto preds = [&] (unsigned int pos) -> const std::vector<unsigned int> & {
+    return reverse ? stmt_info[pos].next : stmt_info[pos].prev;
+  };
+
+  std::vector<unsigned int> order;
+  std::vector<std::pair<unsigned int, size_t>> stack;
+  Bitset visited(nr_stmts);
+
+  stack.emplace_back(root, 0);
+  visited.set(root);
+
+  while (!stack.empty())
+  {
+    unsigned int pos = stack.back().first;
+    size_t i = stack.back().second++;
+    if (i < succs(pos).size()) {
+      unsigned int npos = succs(pos)[i];
+      if (!visited.get(npos)) {
+        visited.set(npos);
+        stack.emplace_back(npos, 0);
+      }
+      continue;
+    }
+    order.emplace_back(pos);
+    stack.pop_back();
+  }
+  std::reverse(order.begin(), order.end());
+
+  std::vector<unsigned int> rpo;
+  rpo.resize(nr_stmts, ~0u);
+  for (size_t i = 0; i < order.size(); ++i)
+    rpo[order[i]] = i;
+
+  std::vector<unsigned int> idoms;
+  idoms.resize(nr_stmts, ~0u);
+  idoms[root] = root;
+
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (auto pos : order)
+    {
+      if (pos == root)
+        continue;
+
+      unsigned int dom = ~0u;
+      for (auto ppos : preds(pos))
+      {
+        if (idoms[ppos] == ~0u)
+          continue;
+        if (dom == ~0u) {
+          dom = ppos;
+          continue;
+        }
+        while (dom != ppos)
+        {
+          while (rpo[dom] > rpo[ppos])
+            dom = idoms[dom];
+          while (rpo[ppos] > rpo[dom])
+            ppos = idoms[ppos];
+        }
+      }
+
+      if (idoms[pos] != dom) {
+        idoms[pos] = dom;
+        changed = true;
+      }
+    }
+  }
+
+  return idoms;
+}
+
+void MirFuncContext::compute_idoms(void)
+{
+  idoms = calc_dominators(stmt_info, 0, false);
+}
+
+void MirFuncContext::remove_dead_code(void)
+{
+  const size_t nr_stmts = stmt_info.size();
+  const unsigned int exit = nr_stmts - 1;
+
+  std::vector<unsigned int> ipdoms = calc_dominators(stmt_info, exit, true);
+
+  std::vector<std::vector<unsigned int>> ctrl_deps(nr_stmts);
+  for (unsigned int pos = 0; pos < nr_stmts; ++pos)
+  {
+    if (stmt_info[pos].next.size() < 2)
+      continue;
+    for (auto npos : stmt_info[pos].next)
+    {
+      unsigned int x = npos;
+      while (x != ~0u && x != ipdoms[pos])
+      {
+        ctrl_deps[x].emplace_back(pos);
+        x = x == exit ? ~0u : ipdoms[x];
+      }
+    }
+  }
+
+  std::vector<MirLabel> stmt_label(nr_stmts, ~0u);
+  for (MirLabel label = 0; label < func->labels.size(); ++label)
+    stmt_label[func->labels[label]] = label;
+
+  std::vector<std::vector<unsigned int>> def_stmts(num_phis);
+  for (unsigned int i = 0; i < func->num_args; ++i)
+    def_stmts[i].emplace_back(0);
+  for (unsigned int pos = 0; pos < nr_stmts; ++pos)
+    if (stmt_info[pos].def != ~0u)
+      def_stmts[stmt_info[pos].def].emplace_back(pos);
+
+  Bitset live(nr_stmts);
+  std::queue<unsigned int> queue;
+  auto mark = [&] (unsigned int pos) {
+    if (!live.get(pos)) {
+      live.set(pos);
+      queue.push(pos);
+    }
+  };
+
+  for (unsigned int pos = 0; pos < nr_stmts; ++pos)
+  {
+    const auto &stmt = func->stmts[pos];
+    if (pos == 0 || pos == exit || stmt->is_return()
+        || stmt->maybe_mem_store() || stmt_info[pos].func_call) {
+      mark(pos);
+    } else if (stmt->maybe_jump() && !stmt->is_jump()) {
+      unsigned int ipdom = ipdoms[pos];
+      if (ipdom == ~0u || (stmt_label[ipdom] == ~0u && ipdom != pos + 1))
+        mark(pos);
+    }
+  }
+
+  while (!queue.empty())
+  {
+    unsigned int pos = queue.front();
+    queue.pop();
+
+    for (auto use : func->stmts[pos]->get_uses())
+    {
+      if (use == ~0u)
+        continue;
+      for (auto dpos : def_stmts[use])
+        mark(dpos);
+    }
+    for (auto cpos : ctrl_deps[pos])
+      mark(cpos);
+  }
+
+  bool changed = false;
+  Bitset removed_stmts(nr_stmts);
+  std::vector<MirCfgEdit> edits;
+  for (unsigned int pos = 1; pos < exit; ++pos)
+  {
+    auto &stmt = func->stmts[pos];
+    if (live.get(pos) || stmt->is_empty() || stmt->is_jump())
+      continue;
+
+    if (stmt->maybe_jump()) {
+      MirLabel label = stmt_label[ipdoms[pos]];
+      if (label != ~0u)
+        edits.emplace_back(pos, std::make_unique<MirJumpStmt>(label));
+      else
+        edits.emplace_back(pos, std::make_unique<MirEmptyStmt>());
+    } else {
+      removed_stmts.set(pos);
+      changed = true;
+    }
+  }
+  changed |= apply_cfg_edits(edits);
+
+  if (changed) {
+    mark_unreachable(removed_stmts);
+    remove_stmts(removed_stmts);
+  }
+}
+
+/*
+ * Edits which would break the loop structure expected by the register
+ * allocator (see identify_loops) are rolled back one by one.
+ */
+bool MirFuncContext::apply_cfg_edits(std::vector<MirCfgEdit> &edits)
+{
+  auto swap = [&] (MirCfgEdit &edit) {
+    auto &stmt = func->stmts[edit.pos];
+    if (edit.stmt) {
+      std::swap(stmt, edit.stmt);
+    } else {
+      MirLabel label = stmt->get_target();
+      stmt->set_target(edit.target);
+      edit.target = label;
+    }
+  };
+
+  if (edits.empty())
+    return false;
+
+  for (auto &edit : edits)
+    swap(edit);
+  if (check_loops())
+    return true;
+
+  bool changed = false;
+  for (auto &edit : edits)
+    swap(edit);
+  for (auto &edit : edits)
+  {
+    swap(edit);
+    if (check_loops())
+      changed = true;
+    else
+      swap(edit);
+  }
+  invalidate();
+
+  return changed;
+}
+
+void MirFuncContext::mark_unreachable(Bitset &removed_stmts)
+{
+  invalidate();
+  require(MirAnalysis::StmtInfo);
+
+  Bitset labeled(stmt_info.size());
+  for (auto pos : func->labels)
+    labeled.set(pos);
+
+  Bitset reachable = calc_reachable();
+  for (unsigned int pos = 1; pos < stmt_info.size() - 1; ++pos)
+    if (!reachable.get(pos) && !labeled.get(pos))
+      removed_stmts.set(pos);
+}
+
+void MirFuncContext::simplify_cfg(const MirOptions *options)
+{
+  const size_t nr_stmts = stmt_info.size();
+  const unsigned int exit = nr_stmts - 1;
+  bool changed = false;
+
+  MirConstEnv env(options->rodata);
+  calc_constants(env);
+
+  std::vector<MirCfgEdit> edits;
+  for (unsigned int pos = 1; pos < exit; ++pos)
+  {
+    auto stmt = func->stmts[pos]->fold_branch(env);
+    if (stmt)
+      edits.emplace_back(pos, std::move(stmt));
+  }
+  changed |= apply_cfg_edits(edits);
+  edits.clear();
+
+  auto skip_empty = [&] (unsigned int pos) {
+    while (pos < exit && func->stmts[pos]->is_empty())
+      ++pos;
+    return pos;
+  };
+
+  for (unsigned int pos = 1; pos < exit; ++pos)
+  {
+    const auto &stmt = func->stmts[pos];
+    MirLabel label = stmt->get_target();
+    if (label == ~0u)
+      continue;
+
+    for (unsigned int i = 0; i < nr_stmts; ++i)
+    {
+      unsigned int tpos = skip_empty(func->labels[label]);
+      if (!func->stmts[tpos]->is_jump())
+        break;
+      MirLabel next = func->stmts[tpos]->get_target();
+      if (next == label)
+        break;
+      label = next;
+    }
+
+    if (label != stmt->get_target())
+      edits.emplace_back(pos, label);
+  }
+  changed |= apply_cfg_edits(edits);
+
+  Bitset removed_stmts(nr_stmts);
+  mark_unreachable(removed_stmts);
+  changed |= (bool) removed_stmts;
+
+  Bitset reachable = calc_reachable();
+
+  for (unsigned int pos = 1; pos < exit; ++pos)
+  {
+    auto &stmt = func->stmts[pos];
+    MirLabel label = stmt->get_target();
+    if (label == ~0u || !reachable.get(pos))
+      continue;
+
+    unsigned int tpos = func->labels[label];
+    if (tpos <= pos)
+      continue;
+
+    bool fallthrough = true;
+    for (unsigned int i = pos + 1; i < tpos && fallthrough; ++i)
+      fallthrough = removed_stmts.get(i)
+        || (func->stmts[i]->is_empty() && !reachable.get(i));
+    if (fallthrough) {
+      stmt = std::make_unique<MirEmptyStmt>();
+      changed = true;
+    }
+  }
+
+  if (!changed)
+    return;
+  remove_stmts(removed_stmts);
+
+  /* A folded loop guard leaves the copies made for skipping the loop
+   * without uses. */
+  repair_phis();
+}
+
+static const unsigned int g_thread_max_copies = 4;
+static const unsigned int g_thread_max_depth = 16;
+static const unsigned int g_thread_max_rounds = 4;
+
+/* A relation between two values is a set of {<, =, >}. */
+static unsigned int relation_mask(MirLogicalOp op)
+{
+  switch (op)
+  {
+  case MirLogicalOp::Lt:
+    return 1;
+  case MirLogicalOp::Leq:
+    return 3;
+  case MirLogicalOp::Eq:
+    return 2;
+  case MirLogicalOp::Ne:
+    return 5;
+  }
+  return 7;
+}
+
+static unsigned int mirror_relation(unsigned int mask)
+{
+  return (mask & 2) | (mask & 1) << 2 | (mask & 4) >> 2;
+}
+
+/*
+ * Decides the outcome of the branch at `branch` when it is entered from
+ * the jump or branch at `pos` through the label at `start`, by walking
+ * backwards along the path as long as it has a single predecessor.
+ */
+bool MirFuncContext::thread_outcome(unsigned int pos, unsigned int start,
+    unsigned int branch, const MirConstEnv &env, bool &taken) const
+{
+  MirLocal src[2];
+  MirLogicalOp op;
+  bool ok = func->stmts[branch]->extract_if_branch(src[0], src[1], op);
+  assert(ok);
+
+  bool known[2] = { false, false };
+  bool frozen[2] = { false, false };
+  int value[2];
+  unsigned int mask = 7;
+
+  auto resolve = [&] (MirLocal local, int &result) {
+    MirConst con;
+    if (local == ~0u) {
+      result = 0;
+      return true;
+    }
+    if (!env.lookup(local, con) || con.sym)
+      return false;
+    result = con.value;
+    return true;
+  };
+  for (int k = 0; k < 2; ++k)
+    known[k] = resolve(src[k], value[k]);
+
+  auto visit = [&] (unsigned int ppos, unsigned int npos) {
+    const auto &stmt = func->stmts[ppos];
+    for (int k = 0; k < 2; ++k)
+    {
+      if (known[k] || frozen[k] || stmt_info[ppos].def != src[k])
+        continue;
+      std::pair<MirLocal, MirLocal> eq;
+      if (stmt->extract_if_assign(eq)) {
+        src[k] = eq.second;
+        known[k] = resolve(src[k], value[k]);
+      } else {
+        frozen[k] = true;
+      }
+    }
+
+    MirLocal lhs, rhs;
+    MirLogicalOp bop;
+    if (!stmt->extract_if_branch(lhs, rhs, bop))
+      return;
+    unsigned int tpos = func->labels[stmt->get_target()];
+    if (tpos == ppos + 1)
+      return;
+
+    unsigned int fact = relation_mask(bop);
+    if (npos != tpos)
+      fact = 7 & ~fact;
+    if (frozen[0] || frozen[1])
+      return;
+
+    if (lhs == src[0] && rhs == src[1])
+      mask &= fact;
+    else if (lhs == src[1] && rhs == src[0])
+      mask &= mirror_relation(fact);
+
+    int con;
+    for (int k = 0; k < 2 && fact == 2; ++k)
+    {
+      if (known[k])
+        continue;
+      if ((lhs == src[k] && resolve(rhs, con))
+          || (rhs == src[k] && resolve(lhs, con))) {
+        known[k] = true;
+        value[k] = con;
+      }
+    }
+  };
+
+  for (unsigned int ppos = branch; ppos-- > start;)
+    visit(ppos, ppos + 1);
+  visit(pos, start);
+
+  unsigned int cur = pos;
+  for (unsigned int i = 0; i < g_thread_max_depth; ++i)
+  {
+    if (stmt_info[cur].prev.size() != 1)
+      break;
+    unsigned int ppos = stmt_info[cur].prev[0];
+    visit(ppos, cur);
+    cur = ppos;
+  }
+
+  if (known[0] && known[1])
+    mask &= value[0] < value[1] ? 1 : value[0] == value[1] ? 2 : 4;
+  else if (src[0] == src[1] && !frozen[0] && !frozen[1])
+    mask &= 2;
+
+  unsigned int cond = relation_mask(op);
+  if ((mask & ~cond) == 0)
+    taken = true;
+  else if ((mask & cond) == 0)
+    taken = false;
+  else
+    return false;
+  return true;
+}
+
+/*
+ * Redirects jumps and branches whose target branch has a known outcome
+ * on that edge. Phi copies between the label and the branch, up to
+ * g_thread_max_copies, are duplicated in front of a redirected jump, or
+ * moved to a new block placed after the next jump for a branch.
+ */
+void MirFuncContext::thread_jumps(const MirOptions *options)
+{
+  for (unsigned int i = 0; i < g_thread_max_rounds; ++i)
+    if (!thread_jumps_once(options))
+      break;
+}
+
+bool MirFuncContext::thread_jumps_once(const MirOptions *options)
+{
+  require(MirAnalysis::StmtInfo);
+
+  const size_t nr_stmts = stmt_info.size();
+  const unsigned int exit = nr_stmts - 1;
+
+  MirConstEnv env(options->rodata);
+  calc_constants(env);
+
+  std::vector<MirLabel> stmt_label(nr_stmts, ~0u);
+  for (MirLabel label = 0; label < func->labels.size(); ++label)
+    stmt_label[func->labels[label]] = label;
+
+  Bitset reachable = calc_reachable();
+
+  std::vector<MirCfgEdit> edits;
+  std::vector<std::pair<unsigned int, unsigned int>> copies;
+  std::vector<unsigned int> blocks;
+  for (unsigned int pos = 1; pos < exit; ++pos)
+  {
+    const auto &stmt = func->stmts[pos];
+    MirLabel label = stmt->get_target();
+    if (label == ~0u || !reachable.get(pos))
+      continue;
+
+    unsigned int start = func->labels[label];
+    unsigned int branch = start, nr_copies = 0;
+    for (; branch < exit; ++branch)
+    {
+      const auto &bstmt = func->stmts[branch];
+      std::pair<MirLocal, MirLocal> eq;
+      if (bstmt->is_empty())
+        continue;
+      if (nr_copies < g_thread_max_copies
+          && bstmt->extract_if_assign(eq) && eq.first >= func->num_temps) {
+        ++nr_copies;
+        continue;
+      }
+      break;
+    }
+
+    MirLocal src1, src2;
+    MirLogicalOp op;
+    if (branch == pos || branch >= exit
+        || !func->stmts[branch]->extract_if_branch(src1, src2, op))
+      continue;
+
+    bool taken;
+    if (!thread_outcome(pos, start, branch, env, taken))
+      continue;
+
+    MirLabel next = stmt_label[branch + 1];
+    if (taken)
+      next = func->stmts[branch]->get_target();
+    else if (func->stmts[branch + 1]->is_jump())
+      next = func->stmts[branch + 1]->get_target();
+    if (next == ~0u || next == label)
+      continue;
+
+    unsigned int block = ~0u;
+    if (nr_copies != 0 && !stmt->is_jump()) {
+      for (unsigned int i = pos + 1; i < exit && block == ~0u; ++i)
+        if (func->stmts[i]->is_jump() || func->stmts[i]->is_return())
+          block = i + 1;
+      if (block == ~0u)
+        continue;
+    }
+
+    edits.emplace_back(pos, next);
+    copies.emplace_back(start, nr_copies ? branch : start);
+    blocks.emplace_back(block);
+  }
+
+  unsigned int nr_blocks = 0;
+  for (auto block : blocks)
+    nr_blocks += block != ~0u;
+
+  MirLabel old_exit = get_exit_label();
+  if (nr_blocks != 0) {
+    func->labels.resize(func->labels.size() + nr_blocks, func->labels.back());
+    for (auto &stmt : func->stmts)
+      if (stmt->get_target() == old_exit)
+        stmt->set_target(get_exit_label());
+    for (auto &edit : edits)
+      if (edit.target == old_exit)
+        edit.target = get_exit_label();
+  }
+
+  std::vector<std::pair<unsigned int, std::unique_ptr<MirStmt>>> inserted;
+  std::vector<std::pair<MirLabel, size_t>> new_labels;
+  auto copy_stmts = [&] (unsigned int pos, unsigned int first,
+      unsigned int last) {
+    for (unsigned int cpos = first; cpos < last; ++cpos)
+    {
+      std::pair<MirLocal, MirLocal> eq;
+      if (!func->stmts[cpos]->extract_if_assign(eq))
+        continue;
+      inserted.emplace_back(pos, std::make_unique<MirUnaryStmt>(
+            eq.first, eq.second, MirUnaryOp::Nop));
+    }
+  };
+
+  for (size_t i = 0; i < edits.size(); ++i)
+  {
+    if (blocks[i] == ~0u)
+      continue;
+
+    MirLabel label = old_exit + new_labels.size();
+    new_labels.emplace_back(label, inserted.size());
+    inserted.emplace_back(blocks[i], std::make_unique<MirEmptyStmt>());
+    copy_stmts(blocks[i], copies[i].first, copies[i].second);
+    inserted.emplace_back(blocks[i],
+        std::make_unique<MirJumpStmt>(edits[i].target));
+
+    edits[i].target = label;
+    copies[i].second = copies[i].first;
+  }
+
+  if (!inserted.empty()) {
+    std::vector<unsigned int> new_pos = insert_stmts(inserted);
+    for (auto [label, index] : new_labels)
+      func->labels[label] = inserted[index].first;
+    for (size_t i = 0; i < edits.size(); ++i)
+    {
+      edits[i].pos = new_pos[edits[i].pos];
+      copies[i].first = new_pos[copies[i].first];
+      copies[i].second = new_pos[copies[i].second];
+    }
+    inserted.clear();
+  }
+
+  std::vector<MirLabel> targets;
+  for (const auto &edit : edits)
+    targets.emplace_back(edit.target);
+  bool changed = apply_cfg_edits(edits);
+  if (!changed && nr_blocks == 0) {
+    invalidate();
+    return false;
+  }
+
+  for (size_t i = 0; i < edits.size(); ++i)
+  {
+    unsigned int pos = edits[i].pos;
+    if (func->stmts[pos]->get_target() == targets[i])
+      copy_stmts(pos, copies[i].first, copies[i].second);
+  }
+  if (!inserted.empty())
+    insert_stmts(inserted);
+
+  /* Split blocks of rolled back edits are unreachable now. */
+  Bitset removed_stmts(func->stmts.size());
+  mark_unreachable(removed_stmts);
+  remove_stmts(removed_stmts);
+  if (changed)
+    repair_phis();
+  return changed;
+}
+
+/*
+ * Restores what the register allocator expects from phis after copies
+ * have been duplicated: every copy reaches a use, and the copies and uses
+ * of a phi form a single live range. Dead copies (and temporaries only
+ * used by them) are removed, and each disconnected part of a live range
+ * is given a new phi.
+ */
+void MirFuncContext::repair_phis(void)
+{
+  invalidate();
+  require(MirAnalysis::StmtInfo);
+
+  const size_t nr_stmts = stmt_info.size();
+  const unsigned int nr_phis = num_phis - func->num_temps;
+
+  std::vector<std::vector<unsigned int>> phi_uses(nr_stmts);
+  for (unsigned int pos = 0; pos < nr_stmts; ++pos)
+    for (auto use : func->stmts[pos]->get_uses())
+      if (use != ~0u && use >= func->num_temps)
+        phi_uses[pos].emplace_back(use - func->num_temps);
+
+  auto phi_def = [&] (unsigned int pos) {
+    MirLocal def = stmt_info[pos].def;
+    if (def == ~0u || def < func->num_temps || stmt_info[pos].func_call)
+      return ~0u;
+    return (unsigned int) (def - func->num_temps);
+  };
+
+  std::vector<unsigned int> nr_uses(num_phis, 0);
+  for (unsigned int pos = 0; pos < nr_stmts; ++pos)
+    for (auto use : func->stmts[pos]->get_uses())
+      if (use != ~0u)
+        ++nr_uses[use];
+
+  Bitset removed_stmts(nr_stmts);
+  auto remove = [&] (unsigned int pos) {
+    removed_stmts.set(pos);
+    for (auto use : func->stmts[pos]->get_uses())
+      if (use != ~0u)
+        --nr_uses[use];
+  };
+
+  std::vector<Bitset> live_in(nr_stmts, Bitset(nr_phis));
+  Bitset live(nr_phis);
+
+  bool removed = true;
+  while (removed)
+  {
+    for (auto &bits : live_in)
+      bits.reset();
+
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+      for (unsigned int pos = nr_stmts; pos-- > 0;)
+      {
+        live.reset();
+        for (auto npos : stmt_info[pos].next)
+          live |= live_in[npos];
+        if (!removed_stmts.get(pos)) {
+          if (phi_def(pos) != ~0u)
+            live.clr(phi_def(pos));
+          for (auto use : phi_uses[pos])
+            live.set(use);
+        }
+        if (!live_in[pos].contain(live)) {
+          live_in[pos] |= live;
+          changed = true;
+        }
+      }
+    }
+
+    removed = false;
+    for (unsigned int pos = 1; pos < nr_stmts; ++pos)
+    {
+      unsigned int def = phi_def(pos);
+      if (def == ~0u || removed_stmts.get(pos))
+        continue;
+
+      bool used = false;
+      for (auto npos : stmt_info[pos].next)
+        used |= live_in[npos].get(def);
+      if (!used) {
+        remove(pos);
+        removed = true;
+      }
+    }
+
+    changed = true;
+    while (changed)
+    {
+      changed = false;
+      for (unsigned int pos = 1; pos < nr_stmts; ++pos)
+      {
+        MirLocal def = stmt_info[pos].def;
+        if (def == ~0u || def < func->num_locals || def >= func->num_temps)
+          continue;
+        if (removed_stmts.get(pos) || stmt_info[pos].func_call)
+          continue;
+        if (nr_uses[def] == 0) {
+          remove(pos);
+          changed = removed = true;
+        }
+      }
+    }
+  }
+
+  std::vector<unsigned int> parent(nr_stmts * 2);
+  std::function<unsigned int (unsigned int)> find = [&] (unsigned int x) {
+    if (parent[x] != x)
+      parent[x] = find(parent[x]);
+    return parent[x];
+  };
+
+  std::vector<std::vector<unsigned int>> phi_defs(nr_phis);
+  for (unsigned int pos = 1; pos < nr_stmts; ++pos)
+    if (phi_def(pos) != ~0u && !removed_stmts.get(pos))
+      phi_defs[phi_def(pos)].emplace_back(pos);
+
+  for (unsigned int phi = 0; phi < nr_phis; ++phi)
+  {
+    if (phi_defs[phi].size() < 2)
+      continue;
+
+    for (unsigned int x = 0; x < parent.size(); ++x)
+      parent[x] = x;
+
+    for (unsigned int pos = 0; pos < nr_stmts; ++pos)
+    {
+      if (!live_in[pos].get(phi))
+        continue;
+      if (phi_def(pos) != phi || removed_stmts.get(pos))
+        parent[find(nr_stmts + pos)] = find(pos);
+      for (auto ppos : stmt_info[pos].prev)
+        parent[find(ppos)] = find(nr_stmts + pos);
+    }
+
+    MirLocal local = func->num_temps + phi;
+    std::unordered_map<unsigned int, MirLocal> webs;
+    for (auto pos : phi_defs[phi])
+    {
+      auto it = webs.find(find(pos));
+      if (it == webs.end())
+        it = webs.emplace(find(pos),
+            webs.empty() ? local : new_phi()).first;
+      if (it->second == local)
+        continue;
+
+      std::pair<MirLocal, MirLocal> eq;
+      bool ok = func->stmts[pos]->extract_if_assign(eq);
+      assert(ok);
+      func->stmts[pos] = std::make_unique<MirUnaryStmt>(
+          it->second, eq.second, MirUnaryOp::Nop);
+    }
+
+    for (unsigned int pos = 0; pos < nr_stmts; ++pos)
+    {
+      if (removed_stmts.get(pos) || !live_in[pos].get(phi))
+        continue;
+      if (std::find(phi_uses[pos].begin(), phi_uses[pos].end(), phi)
+          == phi_uses[pos].end())
+        continue;
+
+      auto it = webs.find(find(nr_stmts + pos));
+      assert(it != webs.end());
+      if (it->second != local)
+        func->stmts[pos]->replace(local, it->second);
+    }
+  }
+
+  remove_stmts(removed_stmts);
+}
+
+bool MirStmt::can_speculate(void) const
+{
+  return false;
+}
+
+bool MirSymbolAddrStmt::can_speculate(void) const
+{
+  return true;
+}
+
+bool MirArrayAddrStmt::can_speculate(void) const
+{
+  return true;
+}
+
+bool MirImmStmt::can_speculate(void) const
+{
+  return true;
+}
+
+bool MirBinaryStmt::can_speculate(void) const
+{
+  return op != MirBinaryOp::Div && op != MirBinaryOp::Mod;
+}
+
+bool MirBinaryImmStmt::can_speculate(void) const
+{
+  return true;
+}
+
+bool MirUnaryStmt::can_speculate(void) const
+{
+  return true;
+}
+
+static const unsigned int g_ifconv_max_arm = 4;
+static const unsigned int g_ifconv_branch_cost = 4;
+static const unsigned int g_ifconv_max_rounds = 4;
+
+struct MirIfArm
+{
+  MirIfArm(void)
+    : cost(0), stmts(), copies(), values()
+  {}
+
+  unsigned int cost;
+  std::vector<unsigned int> stmts;
+  std::vector<unsigned int> copies;
+  std::unordered_map<MirLocal, MirLocal> values;
+};
+
+/*
+ * Replaces small hammocks (a branch over one or two arms of side-effect
+ * free statements that end with phi copies) by straight-line code. Both
+ * arms are executed and each phi gets `y ^ ((x ^ y) & -cond)`, which is
+ * done when it is expected to be cheaper than a data-dependent branch.
+ * Zbb turns such selects into min/max or andn and Zicond into czero.
+ */
+void MirFuncContext::if_convert(const MirOptions *options)
+{
+  for (unsigned int i = 0; i < g_ifconv_max_rounds; ++i)
+    if (!if_convert_once(options))
+      break;
+}
+
+bool MirFuncContext::if_convert_once(const MirOptions *options)
+{
+  require(MirAnalysis::StmtInfo);
+
+  const size_t nr_stmts = stmt_info.size();
+  const unsigned int exit = nr_stmts - 1;
+
+  const bool zbb = options->target.has_extension(MirExtension::Zbb);
+  const bool zicond = options->target.has_extension(MirExtension::Zicond);
+
+  std::vector<unsigned int> nr_defs(num_phis, 0);
+  for (unsigned int pos = 1; pos < exit; ++pos)
+    if (stmt_info[pos].def != ~0u)
+      ++nr_defs[stmt_info[pos].def];
+
+  /* Temps are never redefined, so copies between them can be seen
+   * through when matching values. */
+  std::vector<MirLocal> copy_of(func->num_temps, ~0u);
+  for (unsigned int pos = 1; pos < exit; ++pos)
+  {
+    std::pair<MirLocal, MirLocal> eq;
+    if (func->stmts[pos]->extract_if_assign(eq) && eq.first >= func->num_locals
+        && eq.first < func->num_temps
+        && eq.second < func->num_temps)
+      copy_of[eq.first] = eq.second;
+  }
+  auto resolve = [&] (MirLocal local) {
+    while (local != ~0u && local < func->num_temps && copy_of[local] != ~0u)
+      local = copy_of[local];
+    return local;
+  };
+
+  auto is_phi_copy = [&] (unsigned int pos, std::pair<MirLocal, MirLocal> &eq) {
+    return func->stmts[pos]->extract_if_assign(eq)
+      && eq.first >= func->num_temps;
+  };
+
+  auto scan_arm = [&] (unsigned int pos, unsigned int start,
+      unsigned int limit, MirIfArm &arm) {
+    unsigned int pred = pos;
+    for (unsigned int i = start; i < limit; pred = i++)
+    {
+      const auto &prev = stmt_info[i].prev;
+      if (prev.size() != 1 || prev[0] != pred)
+        return ~0u;
+
+      const auto &stmt = func->stmts[i];
+      MirLocal def = stmt_info[i].def;
+      std::pair<MirLocal, MirLocal> eq;
+      if (stmt->is_jump()) {
+        return i;
+      } else if (stmt->is_empty()) {
+        continue;
+      } else if (is_phi_copy(i, eq)) {
+        auto it = arm.values.find(eq.second);
+        arm.values[eq.first] = it != arm.values.end() ? it->second : eq.second;
+        arm.copies.emplace_back(i);
+      } else if (def != ~0u && def >= func->num_locals
+          && !stmt_info[i].func_call && stmt->can_speculate()
+          && arm.copies.empty()
+          && (def < func->num_temps || nr_defs[def] == 1)) {
+        arm.cost += !stmt->extract_if_assign(eq);
+        arm.stmts.emplace_back(i);
+      } else {
+        return ~0u;
+      }
+    }
+    return limit;
+  };
+
+  Bitset busy(nr_stmts);
+  Bitset removed_stmts(nr_stmts);
+  std::vector<std::pair<unsigned int, std::unique_ptr<MirStmt>>> inserted;
+  std::vector<MirCfgEdit> edits;
+
+  for (unsigned int pos = exit - 1; pos > 0; --pos)
+  {
+    MirLocal src1, src2;
+    MirLogicalOp op;
+    if (!func->stmts[pos]->extract_if_branch(src1, src2, op))
+      continue;
+    if (src1 == ~0u && src2 == ~0u)
+      continue;
+
+    unsigned int target = label_to_stmt_id(func->stmts[pos]->get_target());
+    if (target <= pos + 1)
+      continue;
+
+    MirIfArm arms[2];
+    unsigned int jump = scan_arm(pos, pos + 1, target, arms[0]);
+    unsigned int merge, last;
+    if (jump == target) {
+      merge = target;
+      last = target - 1;
+      jump = ~0u;
+    } else if (jump == target - 1) {
+      merge = label_to_stmt_id(func->stmts[jump]->get_target());
+      if (merge <= target || merge >= exit)
+        continue;
+      if (scan_arm(pos, target, merge, arms[1]) != merge)
+        continue;
+      last = merge - 1;
+    } else {
+      continue;
+    }
+
+    const auto &prev = stmt_info[merge].prev;
+    unsigned int from = jump == ~0u ? pos : jump;
+    if (prev.size() != 2 || (prev[0] != from && prev[1] != from)
+        || (prev[0] != last && prev[1] != last))
+      continue;
+
+    unsigned int nr_spec = arms[0].cost + arms[1].cost;
+    if (arms[0].cost > g_ifconv_max_arm || arms[1].cost > g_ifconv_max_arm)
+      continue;
+
+    std::vector<MirLocal> phis;
+    for (const auto &arm : arms)
+      for (auto copy : arm.copies)
+      {
+        MirLocal phi = stmt_info[copy].def;
+        if (std::find(phis.begin(), phis.end(), phi) == phis.end())
+          phis.emplace_back(phi);
+      }
+
+    /* Phis missing from an arm take the value copied right before the
+     * branch, and that copy goes away. */
+    unsigned int start = pos;
+    std::unordered_map<MirLocal, std::pair<unsigned int, MirLocal>> before;
+    std::pair<MirLocal, MirLocal> eq;
+    while (start > 1 && is_phi_copy(start - 1, eq))
+      --start;
+    for (unsigned int i = start; i < pos; ++i)
+    {
+      is_phi_copy(i, eq);
+      auto it = before.find(eq.second);
+      if (it != before.end())
+        eq.second = it->second.second;
+      before[eq.first] = std::make_pair(i, eq.second);
+    }
+
+    bool ok = true;
+    for (unsigned int i = start; i <= merge; ++i)
+      ok &= !busy.get(i);
+    if (!ok)
+      continue;
+
+    std::vector<std::pair<MirLocal, MirLocal>> values;
+    std::vector<unsigned int> removed;
+    for (auto phi : phis)
+    {
+      MirLocal value[2];
+      for (unsigned int k = 0; k < 2; ++k)
+      {
+        auto it = arms[k].values.find(phi);
+        if (it != arms[k].values.end()) {
+          value[k] = it->second;
+          continue;
+        }
+        auto jt = before.find(phi);
+        if (jt == before.end()) {
+          ok = false;
+          break;
+        }
+        value[k] = jt->second.second;
+      }
+      if (!ok)
+        break;
+
+      auto jt = before.find(phi);
+      if (jt != before.end()) {
+        for (unsigned int i = jt->second.first + 1; i < pos; ++i)
+          ok &= stmt_info[i].def != jt->second.second;
+        removed.emplace_back(jt->second.first);
+      }
+      values.emplace_back(value[0], value[1]);
+    }
+    if (!ok)
+      continue;
+
+    for (unsigned int i = start; i < merge && ok; ++i)
+    {
+      if (i < pos && std::find(removed.begin(), removed.end(), i)
+          != removed.end())
+        continue;
+      if (i > pos && is_phi_copy(i, eq))
+        continue;
+      for (auto use : func->stmts[i]->get_uses())
+        ok &= std::find(phis.begin(), phis.end(), use) == phis.end();
+    }
+    for (const auto &value : values)
+      ok &= std::find(phis.begin(), phis.end(), value.first) == phis.end()
+        && std::find(phis.begin(), phis.end(), value.second) == phis.end();
+    if (!ok)
+      continue;
+
+    /* Values are (taken, not taken) from now on. */
+    for (auto &value : values)
+      std::swap(value.first, value.second);
+
+    /* With Zbb, a phi that picks one of the compared values is their
+     * minimum or maximum and needs no condition. */
+    auto extremum = [&] (const std::pair<MirLocal, MirLocal> &value,
+        MirBinaryOp &bop) {
+      if (!zbb || (op != MirLogicalOp::Lt && op != MirLogicalOp::Leq))
+        return false;
+      MirLocal x = resolve(value.first), y = resolve(value.second);
+      MirLocal a = resolve(src1), b = resolve(src2);
+      if (x == a && y == b)
+        bop = MirBinaryOp::Min;
+      else if (x == b && y == a)
+        bop = MirBinaryOp::Max;
+      else
+        return false;
+      return true;
+    };
+
+    unsigned int nr_copies = arms[0].copies.size() + arms[1].copies.size();
+    unsigned int cond_cost = 1;
+    if ((op == MirLogicalOp::Eq || op == MirLogicalOp::Ne)
+        && src1 != ~0u && src2 != ~0u)
+      cond_cost = 2;
+    if (zicond && (op == MirLogicalOp::Eq || op == MirLogicalOp::Ne))
+      --cond_cost;
+    unsigned int select_cost = nr_spec;
+    bool need_cond = false;
+    for (const auto &value : values)
+    {
+      MirBinaryOp bop;
+      if (extremum(value, bop)) {
+        select_cost += 1;
+        continue;
+      }
+      need_cond = true;
+      if (zicond && (value.first == ~0u || value.second == ~0u))
+        select_cost += 1;
+      else
+        select_cost += 3;
+    }
+    if (need_cond)
+      select_cost += cond_cost + !zicond;
+    unsigned int branch_cost = 1 + (jump != ~0u)
+      + (nr_spec + nr_copies + 1) / 2 + g_ifconv_branch_cost;
+    if (select_cost > branch_cost)
+      continue;
+
+    /* `cond` is nonzero if the first value is picked, or the second one
+     * if `inverted` is set. Without Zicond, `mask` is `-cond`. */
+    bool inverted = op == MirLogicalOp::Leq
+      || (zicond && op == MirLogicalOp::Eq);
+    MirLocal cond = ~0u, mask = ~0u;
+    std::vector<std::unique_ptr<MirStmt>> stmts;
+    if (need_cond) {
+      switch (op)
+      {
+      case MirLogicalOp::Lt:
+        cond = new_phi();
+        stmts.emplace_back(std::make_unique<MirBinaryStmt>(
+              cond, src1, src2, MirBinaryOp::Lt));
+        break;
+      case MirLogicalOp::Leq:
+        cond = new_phi();
+        stmts.emplace_back(std::make_unique<MirBinaryStmt>(
+              cond, src2, src1, MirBinaryOp::Lt));
+        break;
+      case MirLogicalOp::Eq:
+      case MirLogicalOp::Ne:
+        {
+          if (!zicond)
+            cond = new_phi();
+          MirLocal diff = src1 == ~0u ? src2 : src1;
+          if (src1 != ~0u && src2 != ~0u) {
+            diff = new_phi();
+            stmts.emplace_back(std::make_unique<MirBinaryStmt>(
+                  diff, src1, src2, MirBinaryOp::Sub));
+          }
+          if (zicond)
+            cond = diff;
+          else
+            stmts.emplace_back(std::make_unique<MirUnaryStmt>(cond, diff,
+                  op == MirLogicalOp::Eq ? MirUnaryOp::Eqz : MirUnaryOp::Nez));
+        }
+        break;
+      }
+
+      if (!zicond) {
+        mask = new_phi();
+        stmts.emplace_back(std::make_unique<MirUnaryStmt>(
+              mask, cond, MirUnaryOp::Neg));
+      }
+    }
+
+    if (!phis.empty()) {
+      std::vector<MirLocal> results;
+      std::map<std::pair<MirLocal, MirLocal>, MirLocal> diffs;
+      for (const auto &value : values)
+      {
+        MirBinaryOp bop;
+        if (extremum(value, bop)) {
+          MirLocal result = new_phi();
+          stmts.emplace_back(std::make_unique<MirBinaryStmt>(
+                result, src1, src2, bop));
+          results.emplace_back(result);
+          continue;
+        }
+
+        MirLocal x = value.first, y = value.second;
+        if (inverted)
+          std::swap(x, y);
+        if (x == y) {
+          results.emplace_back(x);
+          continue;
+        }
+
+        if (zicond) {
+          MirLocal picked = ~0u, other = ~0u;
+          if (x != ~0u) {
+            picked = new_phi();
+            stmts.emplace_back(std::make_unique<MirBinaryStmt>(
+                  picked, x, cond, MirBinaryOp::CzeroEqz));
+          }
+          if (y != ~0u) {
+            other = new_phi();
+            stmts.emplace_back(std::make_unique<MirBinaryStmt>(
+                  other, y, cond, MirBinaryOp::CzeroNez));
+          }
+          if (x == ~0u || y == ~0u) {
+            results.emplace_back(x == ~0u ? other : picked);
+            continue;
+          }
+          MirLocal result = new_phi();
+          stmts.emplace_back(std::make_unique<MirBinaryStmt>(
+                result, picked, other, MirBinaryOp::Or));
+          results.emplace_back(result);
+          continue;
+        }
+
+        if (x == ~0u && zbb) {
+          MirLocal result = new_phi();
+          stmts.emplace_back(std::make_unique<MirBinaryStmt>(
+                result, y, mask, MirBinaryOp::Andn));
+          results.emplace_back(result);
+          continue;
+        }
+
+        MirLocal diff = x == ~0u ? y : x;
+        if (x != ~0u && y != ~0u) {
+          auto &cached = diffs[std::minmax(x, y)];
+          if (cached == 0) {
+            cached = new_phi();
+            stmts.emplace_back(std::make_unique<MirBinaryStmt>(
+                  cached, x, y, MirBinaryOp::Xor));
+          }
+          diff = cached;
+        }
+        MirLocal masked = new_phi();
+        stmts.emplace_back(std::make_unique<MirBinaryStmt>(
+              masked, diff, mask, MirBinaryOp::And));
+        if (y == ~0u) {
+          results.emplace_back(masked);
+          continue;
+        }
+        MirLocal result = new_phi();
+        stmts.emplace_back(std::make_unique<MirBinaryStmt>(
+              result, y, masked, MirBinaryOp::Xor));
+        results.emplace_back(result);
+      }
+
+      for (size_t i = 0; i < phis.size(); ++i)
+        stmts.emplace_back(std::make_unique<MirUnaryStmt>(
+              phis[i], results[i], MirUnaryOp::Nop));
+    }
+    for (auto &stmt : stmts)
+      inserted.emplace_back(merge, std::move(stmt));
+
+    edits.emplace_back(pos, std::make_unique<MirEmptyStmt>());
+    if (jump != ~0u)
+      edits.emplace_back(jump, std::make_unique<MirEmptyStmt>());
+    for (const auto &arm : arms)
+      for (auto copy : arm.copies)
+        removed_stmts.set(copy);
+    for (auto copy : removed)
+      removed_stmts.set(copy);
+
+    for (unsigned int i = start; i <= merge; ++i)
+      busy.set(i);
+  }
+
+  if (edits.empty())
+    return false;
+
+  for (auto &edit : edits)
+  {
+    std::swap(func->stmts[edit.pos], edit.stmt);
+    removed_stmts.set(edit.pos);
+  }
+  if (!check_loops()) {
+    for (auto &edit : edits)
+      std::swap(func->stmts[edit.pos], edit.stmt);
+    invalidate();
+    return false;
+  }
+
+  std::vector<unsigned int> new_pos = insert_stmts(inserted);
+  Bitset removed_new(func->stmts.size());
+  for (auto pos : removed_stmts)
+    removed_new.set(new_pos[pos]);
+  remove_stmts(removed_new);
+  return true;
+}
+
+/*
+ * Whether `local`, read at `from`, still holds the same value at `pos`:
+ * temporaries are defined once, other locals must not be redefined on
+ * the straight-line path between the two statements.
+ */
+bool MirFuncContext::holds_same_value(MirLocal local, unsigned int from,
+    unsigned int pos) const
+{
+  if (local >= func->num_locals && local < func->num_temps)
+    return true;
+  for (unsigned int i = from + 1; i <= pos; ++i)
+  {
+    const auto &prev = stmt_info[i].prev;
+    if (prev.size() != 1 || prev[0] != i - 1)
+      return false;
+    if (stmt_info[i].def == local)
+      return false;
+  }
+  return true;
+}
+
+/*
+ * Combines instructions for the extensions enabled by `-march`. With Zba,
+ * `x + (i << k)` and `x * c` for c = 3, 5, 9 become one shNadd.
+ */
+void MirFuncContext::combine_insts(const MirOptions *options)
+{
+  if (!options->target.has_extension(MirExtension::Zba))
+    return;
+
+  MirConstEnv env(options->rodata);
+  calc_constants(env);
+
+  const size_t nr_stmts = stmt_info.size();
+  std::vector<unsigned int> nr_uses(num_phis, 0);
+  std::vector<unsigned int> def_pos(num_phis, ~0u);
+  for (unsigned int pos = 0; pos < nr_stmts; ++pos)
+  {
+    for (auto use : func->stmts[pos]->get_uses())
+      if (use != ~0u)
+        ++nr_uses[use];
+    MirLocal def = stmt_info[pos].def;
+    if (def >= func->num_locals && def < func->num_temps)
+      def_pos[def] = pos;
+  }
+
+  static const MirBinaryOp shift_adds[] = {
+    MirBinaryOp::Add, MirBinaryOp::Sh1Add,
+    MirBinaryOp::Sh2Add, MirBinaryOp::Sh3Add,
+  };
+
+  bool changed = false;
+  for (unsigned int pos = 0; pos < nr_stmts; ++pos)
+  {
+    MirLocal src[2];
+    MirBinaryOp op;
+    if (!func->stmts[pos]->extract_if_binary(src[0], src[1], op))
+      continue;
+    MirLocal def = stmt_info[pos].def;
+
+    if (op == MirBinaryOp::Mul) {
+      for (unsigned int k = 0; k < 2; ++k)
+      {
+        auto it = env.values.find(src[k]);
+        if (src[k] == ~0u || it == env.values.end() || it->second.sym)
+          continue;
+        int value = it->second.value;
+        if (value != 3 && value != 5 && value != 9)
+          continue;
+        MirLocal other = src[1 - k];
+        func->stmts[pos] = std::make_unique<MirBinaryStmt>(def, other, other,
+            shift_adds[__builtin_ctz(value - 1)]);
+        changed = true;
+        break;
+      }
+      continue;
+    }
+
+    if (op != MirBinaryOp::Add)
+      continue;
+    for (unsigned int k = 0; k < 2; ++k)
+    {
+      MirLocal scaled = src[k];
+      if (scaled < func->num_locals || scaled >= func->num_temps
+          || nr_uses[scaled] != 1 || def_pos[scaled] == ~0u)
+        continue;
+
+      MirLocal index;
+      int imm;
+      MirImmOp iop;
+      unsigned int from = def_pos[scaled];
+      if (!func->stmts[from]->extract_if_binary_imm(index, imm, iop)
+          || iop != MirImmOp::Mul || (imm != 2 && imm != 4 && imm != 8)
+          || !holds_same_value(index, from, pos))
+        continue;
+      func->stmts[pos] = std::make_unique<MirBinaryStmt>(def, index,
+          src[1 - k], shift_adds[__builtin_ctz(imm)]);
+      changed = true;
+      break;
+    }
+  }
+
+  if (changed)
+    invalidate();
+}
+
+/*
+ * Moves constant terms of addresses into the offset of the loads and
+ * stores using them:
+ *
+ *   t1 = i + 1; t2 = t1 * 4; t3 = a + t2; load t3, 0
+ *     => t2 = i * 4; t3 = a + t2; load t3, 4
+ *
+ * Array and symbol addresses lose their offsets the same way, so that
+ * neighbouring accesses compute the same base and cse can share it.
+ * Only temporaries with a single use are rewritten.
+ */
+void MirFuncContext::fold_addresses(void)
+{
+  const size_t nr_stmts = stmt_info.size();
+  std::vector<unsigned int> nr_uses(num_phis, 0);
+  std::vector<unsigned int> def_pos(num_phis, ~0u);
+  for (unsigned int pos = 0; pos < nr_stmts; ++pos)
+  {
+    for (auto use : func->stmts[pos]->get_uses())
+      if (use != ~0u)
+        ++nr_uses[use];
+    MirLocal def = stmt_info[pos].def;
+    if (def >= func->num_locals && def < func->num_temps)
+      def_pos[def] = pos;
+  }
+
+  /*
+   * Returns the constant term of `local`, read at `user`, and removes it
+   * from the definitions if `apply` is set. `value` receives the local
+   * that `user` reads instead once an addition has been bypassed, or
+   * `local` itself. Definitions with other users are left alone, except
+   * that `user` may read around an addition.
+   */
+  std::function<off_t (MirLocal, unsigned int, bool, MirLocal &)> split =
+    [&] (MirLocal local, unsigned int user, bool apply,
+        MirLocal &value) -> off_t {
+    value = local;
+    if (local < func->num_locals || local >= func->num_temps
+        || def_pos[local] == ~0u)
+      return 0;
+
+    unsigned int pos = def_pos[local];
+    MirStmt *stmt = func->stmts[pos].get();
+    bool shared = nr_uses[local] != 1;
+    MirLocal src1, src2, base;
+    int imm;
+    MirImmOp iop;
+    MirBinaryOp op;
+    const Symbol *sym;
+    MirArray id;
+    off_t off;
+
+    if (stmt->extract_if_binary_imm(src1, imm, iop)) {
+      if (iop == MirImmOp::Mul)
+        return shared ? 0 : split(src1, pos, apply, base) * imm;
+      if (iop != MirImmOp::Add || src1 == ~0u)
+        return 0;
+      off = 0;
+      base = src1;
+      if (!shared)
+        off = split(src1, pos, apply, base);
+      if (!holds_same_value(base, pos, user))
+        return off;
+      if (apply) {
+        func->stmts[user]->replace(local, base);
+        --nr_uses[local];
+        ++nr_uses[base];
+      }
+      value = base;
+      return off + imm;
+    }
+
+    if (shared)
+      return 0;
+    if (stmt->extract_if_binary(src1, src2, op)) {
+      if (op != MirBinaryOp::Add)
+        return 0;
+      off = split(src1, pos, apply, base);
+      return off + split(src2, pos, apply, base);
+    }
+
+    if (stmt->extract_if_array_addr(id, off)
+        || stmt->extract_if_symbol_addr(sym, off)) {
+      if (apply)
+        stmt->set_offset(0);
+      return off;
+    }
+    return 0;
+  };
+
+  bool changed = false;
+  for (unsigned int pos = 0; pos < nr_stmts; ++pos)
+  {
+    MirLocal address;
+    off_t offset;
+    if (!func->stmts[pos]->extract_if_mem_access(address, offset))
+      continue;
+
+    MirLocal value;
+    off_t delta = split(address, pos, false, value);
+    if (delta == 0 || offset + delta > 2047 || offset + delta < -2047)
+      continue;
+    split(address, pos, true, value);
+    func->stmts[pos]->set_offset(offset + delta);
+    changed = true;
+  }
+
+  if (changed)
+    invalidate();
+}
+
+std::vector<unsigned int> MirFuncContext::calc_blocks(void)
+{
+  Bitset reachable = calc_reachable();
+  const size_t exit = stmt_info.size() - 1;
+
+  std::vector<unsigned int> blocks;
+  for (auto stmt : reachable)
+  {
+    if (stmt == 0 || stmt == exit)
+      continue;
+    const auto &prev = stmt_info[stmt].prev;
+    if (stmt == 1 || prev.size() != 1 || prev[0] != stmt - 1
+        || stmt_info[stmt - 1].next.size() != 1)
+      blocks.emplace_back(stmt);
+  }
+  return blocks;
+}
+
+void MirFuncContext::set_block_counts(
+    const std::vector<unsigned int> &blocks, const unsigned int *counts)
+{
+  stmt_counts.clear();
+  if (counts == nullptr)
+    return;
+
+  Bitset reachable = calc_reachable();
+  const size_t exit = stmt_info.size() - 1;
+
+  stmt_counts.resize(stmt_info.size(), 0);
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    for (unsigned int stmt = blocks[i]; stmt < exit; ++stmt)
+    {
+      if (stmt != blocks[i]
+          && std::binary_search(blocks.begin(), blocks.end(), stmt))
+        break;
+      if (!reachable.get(stmt))
+        break;
+      stmt_counts[stmt] = counts[i];
+    }
+  }
+  stmt_counts[0] = stmt_counts[1];
+  stmt_counts[exit] = stmt_counts[0];
+}
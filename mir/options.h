@@ -0,0 +1,23 @@
+#pragma once
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include "pass.h"
+#include "profile.h"
+#include "target.h"
+
+class MirRodataItem;
+
+struct MirOptions
+{
+  MirOptions(void)
+    : passes(), target(), profile(), rodata(), used_symbols()
+  {}
+
+  MirPassManager passes;
+  MirTarget target;
+  std::unique_ptr<MirProfile> profile;
+
+  std::unordered_map<Symbol, const MirRodataItem *> rodata;
+  std::unordered_set<Symbol> used_symbols;
+};
@@ -0,0 +1,115 @@
+#include <cstring>
+#include "pass.h"
+
+static const MirPassInfo g_passes[] = {
+  { "const-eval", MirPassKind::Hir },
+  { "licm", MirPassKind::PreSsa },
+  { "unswitch", MirPassKind::PreSsa },
+  { "ssa", MirPassKind::Lower },
+  { "addr-fold", MirPassKind::Ssa },
+  { "cse", MirPassKind::Ssa },
+  { "fold", MirPassKind::Ssa },
+  { "adce", MirPassKind::Ssa },
+  { "simplify-cfg", MirPassKind::Ssa },
+  { "jump-threading", MirPassKind::Ssa },
+  { "if-convert", MirPassKind::Ssa },
+  { "combine", MirPassKind::Ssa },
+  { "dce", MirPassKind::Ssa },
+  { "block-layout", MirPassKind::Emit },
+  { "peephole", MirPassKind::Emit },
+  { "schedule", MirPassKind::Emit },
+};
+
+static const char *g_levels[] = {
+  "",
+  "const-eval,ssa,addr-fold,cse,fold,adce,simplify-cfg,combine,dce,peephole",
+  "const-eval,licm,unswitch,ssa,addr-fold,cse,fold,simplify-cfg,jump-threading,"
+    "adce,simplify-cfg,if-convert,combine,dce,block-layout,peephole,"
+    "schedule",
+  "const-eval,licm,unswitch,ssa,addr-fold,cse,fold,simplify-cfg,jump-threading,"
+    "adce,simplify-cfg,if-convert,combine,dce,block-layout,peephole,"
+    "schedule",
+};
+
+MirPassManager::MirPassManager(void)
+  : passes(), error()
+{
+  set_level(2);
+}
+
+const MirPassInfo *MirPassManager::find_pass(const std::string &name)
+{
+  for (const auto &pass : g_passes)
+    if (name == pass.name)
+      return &pass;
+  return nullptr;
+}
+
+void MirPassManager::set_level(unsigned int level)
+{
+  if (level > 3)
+    level = 3;
+  passes.clear();
+  set_passes(g_levels[level]);
+}
+
+bool MirPassManager::set_passes(const std::string &list)
+{
+  passes.clear();
+  error.clear();
+
+  size_t pos = 0;
+  while (pos < list.size())
+  {
+    size_t end = list.find(',', pos);
+    if (end == std::string::npos)
+      end = list.size();
+    if (!add_pass(list.substr(pos, end - pos)))
+      return false;
+    pos = end + 1;
+  }
+
+  finish();
+  return true;
+}
+
+bool MirPassManager::add_pass(const std::string &name)
+{
+  const MirPassInfo *pass = find_pass(name);
+  if (pass == nullptr) {
+    error = "unknown pass `" + name + "`";
+    return false;
+  }
+
+  if (pass->kind == MirPassKind::PreSsa && has_pass("ssa")) {
+    error = "pass `" + name + "` must run before `ssa`";
+    return false;
+  }
+
+  if (pass->kind == MirPassKind::Ssa && !has_pass("ssa"))
+    passes.emplace_back(find_pass("ssa"));
+  if (pass->kind != MirPassKind::Lower || !has_pass(name))
+    passes.emplace_back(pass);
+  return true;
+}
+
+void MirPassManager::finish(void)
+{
+  if (!has_pass("ssa"))
+    passes.emplace_back(find_pass("ssa"));
+
+  /* Emission passes do not change the MIR, so dce may precede them. */
+  auto last = passes.rbegin();
+  while ((*last)->kind == MirPassKind::Emit)
+    ++last;
+  if (strcmp((*last)->name, "dce") != 0)
+    passes.emplace_back(find_pass("dce"));
+}
+
+bool MirPassManager::has_pass(const std::string &name) const
+{
+  for (auto pass : passes)
+    if (name == pass->name)
+      return true;
+  return false;
+}
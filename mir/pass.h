@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <vector>
+
+enum class MirPassKind
+{
+  Hir,
+  PreSsa,
+  Ssa,
+  Lower,
+  Emit,
+};
+
+struct MirPassInfo
+{
+  const char *name;
+  MirPassKind kind;
+};
+
+class MirPassManager
+{
+public:
+  MirPassManager(void);
+
+  void set_level(unsigned int level);
+  bool set_passes(const std::string &list);
+
+  bool has_pass(const std::string &name) const;
+  const std::vector<const MirPassInfo *> &get_passes(void) const
+  {
+    return passes;
+  }
+
+  const std::string &get_error(void) const
+  {
+    return error;
+  }
+
+  static const MirPassInfo *find_pass(const std::string &name);
+
+private:
+  bool add_pass(const std::string &name);
+  void finish(void);
+
+private:
+  std::vector<const MirPassInfo *> passes;
+  std::string error;
+};
@@ -0,0 +1,199 @@
+#include <fstream>
+#include "profile.h"
+#include "../asm/builder.h"
+#include "../lexer/token.h"
+
+static const unsigned int g_profile_magic = 0x46505953;
+static const unsigned int g_profile_version = 1;
+
+static unsigned int hash_word(unsigned int hash, unsigned int word)
+{
+  for (unsigned int i = 0; i < 4; ++i)
+  {
+    hash ^= (word >> (i * 8)) & 0xff;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static unsigned int hash_name(Symbol name)
+{
+  unsigned int hash = 2166136261u;
+  for (auto ch : name.to_string())
+  {
+    hash ^= static_cast<unsigned char>(ch);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+MirProfile::MirProfile(MirProfileMode mode, std::string &&path)
+  : mode(mode), path(std::move(path)), funcs(), records(),
+    counts(), num_counters(0)
+{}
+
+Symbol MirProfile::make_symbol(const char *str)
+{
+  return Token(str, Location()).to_symbol();
+}
+
+unsigned int MirProfile::checksum(size_t nr_stmts,
+    const std::vector<unsigned int> &blocks)
+{
+  unsigned int hash = hash_word(2166136261u, nr_stmts);
+  for (auto block : blocks)
+    hash = hash_word(hash, block);
+  return hash;
+}
+
+bool MirProfile::load(void)
+{
+  std::ifstream is(path, std::ios::binary);
+  if (!is)
+    return false;
+
+  std::vector<unsigned int> words;
+  unsigned char buf[4];
+  while (is.read(reinterpret_cast<char *>(buf), sizeof(buf)))
+    words.emplace_back(buf[0] | (buf[1] << 8)
+        | (buf[2] << 16) | (static_cast<unsigned int>(buf[3]) << 24));
+  if (is.gcount() != 0)
+    return false;
+
+  if (words.size() < 3
+      || words[0] != g_profile_magic || words[1] != g_profile_version)
+    return false;
+
+  size_t nr_funcs = words[2];
+  size_t pos = 3 + 3 * nr_funcs;
+  if (words.size() < pos)
+    return false;
+
+  unsigned int base = 0;
+  for (size_t i = 0; i < nr_funcs; ++i)
+  {
+    FuncRecord record { words[4 + 3 * i], words[5 + 3 * i], base };
+    records[words[3 + 3 * i]] = record;
+    base += record.num_counters;
+  }
+  if (words.size() != pos + base)
+    return false;
+
+  counts.assign(words.begin() + pos, words.end());
+  return true;
+}
+
+Symbol MirProfile::get_counters(void) const
+{
+  return make_symbol("__sysy_profile_counters");
+}
+
+unsigned int MirProfile::add_func(Symbol name, size_t nr_stmts,
+    const std::vector<unsigned int> &blocks)
+{
+  assert(mode == MirProfileMode::Generate);
+
+  FuncRecord record { checksum(nr_stmts, blocks),
+    static_cast<unsigned int>(blocks.size()), num_counters };
+  funcs.emplace_back(name, record);
+  num_counters += record.num_counters;
+  return record.base;
+}
+
+const unsigned int *MirProfile::find_func(Symbol name, size_t nr_stmts,
+    const std::vector<unsigned int> &blocks) const
+{
+  assert(mode == MirProfileMode::Use);
+
+  auto it = records.find(hash_name(name));
+  if (it == records.end())
+    return nullptr;
+  if (it->second.checksum != checksum(nr_stmts, blocks)
+      || it->second.num_counters != blocks.size())
+    return nullptr;
+  return counts.data() + it->second.base;
+}
+
+void MirProfile::codegen(AsmBuilder *builder) const
+{
+  if (mode != MirProfileMode::Generate)
+    return;
+
+  Symbol header = make_symbol("__sysy_profile_header");
+  Symbol file = make_symbol("__sysy_profile_file");
+  Symbol file_mode = make_symbol("__sysy_profile_mode");
+  Symbol dump = make_symbol("__sysy_profile_dump");
+
+  builder->mk_global_label(AsmLabelSec::Rodata, header);
+  builder->mk_int_directive(AsmIntDirType::Put, g_profile_magic);
+  builder->mk_int_directive(AsmIntDirType::Put, g_profile_version);
+  builder->mk_int_directive(AsmIntDirType::Put, funcs.size());
+  for (const auto &[name, record] : funcs)
+  {
+    builder->mk_int_directive(AsmIntDirType::Put, hash_name(name));
+    builder->mk_int_directive(AsmIntDirType::Put, record.checksum);
+    builder->mk_int_directive(AsmIntDirType::Put, record.num_counters);
+  }
+
+  auto put_string = [&] (Symbol sym, const std::string &str)
+  {
+    builder->mk_global_label(AsmLabelSec::Rodata, sym);
+    for (size_t i = 0; i <= str.size(); i += 4)
+    {
+      unsigned int word = 0;
+      for (size_t j = 0; j < 4 && i + j < str.size(); ++j)
+        word |= static_cast<unsigned char>(str[i + j]) << (j * 8);
+      builder->mk_int_directive(AsmIntDirType::Put, word);
+    }
+  };
+  put_string(file, path);
+  put_string(file_mode, "wb");
+
+  builder->mk_global_label(AsmLabelSec::Bss, get_counters());
+  builder->mk_int_directive(AsmIntDirType::Skip,
+      (num_counters ? num_counters : 1) * sizeof(int));
+
+  builder->mk_global_label(AsmLabelSec::Text, dump);
+  builder->alloc_labels(1);
+
+  builder->mk_binary_imm_inst(AsmBinaryImmOp::Add,
+      Register::SP, Register::SP, -16);
+  builder->mk_memory_inst(AsmMemoryOp::Store,
+      Register::RA, Register::SP, 12);
+  builder->mk_memory_inst(AsmMemoryOp::Store,
+      Register::S0, Register::SP, 8);
+
+  builder->mk_load_addr_inst(Register::A0, file, 0);
+  builder->mk_load_addr_inst(Register::A1, file_mode, 0);
+  builder->mk_call_inst(make_symbol("fopen"));
+  builder->mk_branch_inst(AsmBranchOp::Eq, Register::A0, Register::X0, 0);
+  builder->mk_unary_inst(AsmUnaryOp::Mv, Register::S0, Register::A0);
+
+  builder->mk_load_addr_inst(Register::A0, header, 0);
+  builder->mk_load_imm_inst(Register::A1, sizeof(int));
+  builder->mk_load_imm_inst(Register::A2, 3 + 3 * funcs.size());
+  builder->mk_unary_inst(AsmUnaryOp::Mv, Register::A3, Register::S0);
+  builder->mk_call_inst(make_symbol("fwrite"));
+
+  builder->mk_load_addr_inst(Register::A0, get_counters(), 0);
+  builder->mk_load_imm_inst(Register::A1, sizeof(int));
+  builder->mk_load_imm_inst(Register::A2, num_counters);
+  builder->mk_unary_inst(AsmUnaryOp::Mv, Register::A3, Register::S0);
+  builder->mk_call_inst(make_symbol("fwrite"));
+
+  builder->mk_unary_inst(AsmUnaryOp::Mv, Register::A0, Register::S0);
+  builder->mk_call_inst(make_symbol("fclose"));
+
+  builder->mk_local_label(0);
+  builder->mk_memory_inst(AsmMemoryOp::Load,
+      Register::RA, Register::SP, 12);
+  builder->mk_memory_inst(AsmMemoryOp::Load,
+      Register::S0, Register::SP, 8);
+  builder->mk_binary_imm_inst(AsmBinaryImmOp::Add,
+      Register::SP, Register::SP, 16);
+  builder->mk_jump_reg_inst(Register::RA);
+
+  builder->mk_global_label(AsmLabelSec::FiniArray,
+      make_symbol("__sysy_profile_fini"));
+  builder->mk_sym_directive(dump);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "../lexer/symbol.h"
+
+class AsmBuilder;
+
+enum class MirProfileMode
+{
+  Generate,
+  Use,
+};
+
+class MirProfile
+{
+public:
+  MirProfile(MirProfileMode mode, std::string &&path);
+
+  bool load(void);
+
+  MirProfileMode get_mode(void) const
+  {
+    return mode;
+  }
+
+  Symbol get_counters(void) const;
+
+  unsigned int add_func(Symbol name, size_t nr_stmts,
+      const std::vector<unsigned int> &blocks);
+  const unsigned int *find_func(Symbol name, size_t nr_stmts,
+      const std::vector<unsigned int> &blocks) const;
+
+  void codegen(AsmBuilder *builder) const;
+
+private:
+  static Symbol make_symbol(const char *str);
+  static unsigned int checksum(size_t nr_stmts,
+      const std::vector<unsigned int> &blocks);
+
+private:
+  MirProfileMode mode;
+  std::string path;
+
+  struct FuncRecord
+  {
+    unsigned int checksum;
+    unsigned int num_counters;
+    unsigned int base;
+  };
+
+  std::vector<std::pair<Symbol, FuncRecord>> funcs;
+  std::unordered_map<unsigned int, FuncRecord> records;
+  std::vector<unsigned int> counts;
+  unsigned int num_counters;
+};
@@ -74,7 +74,7 @@ struct MirLocalLiveness
       uint32_t hint, uint32_t forbid)
     : stmts(std::move(stmts)), local(~0u), kids(std::move(kids)),
       loop(0), hint(hint), forbid(forbid), to_spill(false),
-      color(0), uses(), defs(), remat(nullptr)
+      color(0), uses(), defs(), remat(nullptr), splits()
   {}
 
   MirLocalLiveness(Bitset &&stmts,
@@ -82,7 +82,7 @@ struct MirLocalLiveness
       uint32_t forbid, MirStmt *remat)
     : stmts(std::move(stmts)), local(local), kids(),
       loop(0), hint(hint), forbid(forbid), to_spill(false),
-      color(0), uses(), defs(), remat(remat)
+      color(0), uses(), defs(), remat(remat), splits()
   {}
 
   MirLocalLiveness(Bitset &&stmts, MirLocal local,
@@ -90,7 +90,8 @@ struct MirLocalLiveness
       MirOperands &&uses, MirOperands &&defs, MirStmt *remat)
     : stmts(std::move(stmts)), local(local), kids(), loop(loop),
       hint(hint), forbid(forbid), to_spill(false), color(0),
-      uses(std::move(uses)), defs(std::move(defs)), remat(remat)
+      uses(std::move(uses)), defs(std::move(defs)), remat(remat),
+      splits()
   {}
 
   MirLocalLiveness(MirLocalLiveness &&other)
@@ -99,7 +100,7 @@ struct MirLocalLiveness
       hint(other.hint), forbid(other.forbid),
       to_spill(other.to_spill), color(other.color),
       uses(std::move(other.uses)), defs(std::move(other.defs)),
-      remat(other.remat)
+      remat(other.remat), splits(std::move(other.splits))
   {}
 
   MirLocalLiveness &operator =(MirLocalLiveness &&other)
@@ -115,6 +116,7 @@ struct MirLocalLiveness
     uses = std::move(other.uses);
     defs = std::move(other.defs);
     remat = other.remat;
+    splits = std::move(other.splits);
     return *this;
   }
 
@@ -145,6 +147,7 @@ struct MirLocalLiveness
   MirOperands uses;
   MirOperands defs;
   MirStmt *remat;
+  std::vector<unsigned int> splits;
 };
 
 static inline uint32_t reg_hint_callee_arg(uint32_t i)
@@ -199,13 +202,20 @@ static inline uint32_t reg_hint_return_val(void)
   return 1u << static_cast<uint32_t>(Register::A0);
 }
 
+static inline uint32_t reg_forbid_leaf_func(void)
+{
+  return 1u << static_cast<uint32_t>(Register::RA);
+}
+
 MirFuncContext::MirFuncContext(
     MirFuncItem *func, AsmBuilder *builder)
-  : func(func), stmt_info(), defs(), uses(),
-    liveness(), loops(), reg_info(), spilled_locals(),
-    spill_loads(), spill_stores(), num_callee_regs(0),
+  : func(func), stmt_info(), defs(), uses(), stmt_counts(),
+    liveness(), loops(), idoms(), valid_analyses(0),
+    reg_info(), spilled_locals(),
+    num_spill_slots(0), spill_loads(), spill_stores(), num_callee_regs(0),
     builder(builder), num_phis(func->num_temps),
-    tail_reachable(true)
+    tail_reachable(true), leaf_func(false), prologue_pos(0),
+    prologue_moves(), frameless_exits()
 {}
 
 MirFuncContext::~MirFuncContext(void)
@@ -227,6 +237,10 @@ void MirFuncContext::fill_stmt_info(void)
   for (size_t i = 0; i < stmt_info.size(); ++i)
     for (auto npos : stmt_info[i].next)
       stmt_info[npos].prev.emplace_back(i);
+
+  leaf_func = true;
+  for (const auto &info : stmt_info)
+    leaf_func &= !info.func_call;
 }
 
 void MirFuncContext::fill_defs_and_uses(void)
@@ -271,7 +285,7 @@ void MirFuncContext::fill_defs_and_uses(void)
   }
 }
 
-void MirFuncContext::identify_loops(void)
+bool MirFuncContext::find_loops(std::vector<MirLoop> &loops)
 {
   {
     Bitset stmts(stmt_info.size());
@@ -282,11 +296,13 @@ void MirFuncContext::identify_loops(void)
         std::vector<unsigned int>());
   }
 
+  Bitset reachable = calc_reachable();
+
   for (size_t pos = 0; pos < stmt_info.size(); ++pos)
   {
     unsigned int ppos_max = 0;
     for (auto ppos : stmt_info[pos].prev)
-      if (ppos > ppos_max)
+      if (ppos > ppos_max && reachable.get(ppos))
         ppos_max = ppos;
     if (ppos_max <= pos)
       continue;
@@ -296,7 +312,7 @@ void MirFuncContext::identify_loops(void)
     stmts.set(pos);
     for (auto ppos : stmt_info[pos].prev)
     {
-      if (ppos > pos) {
+      if (ppos > pos && reachable.get(ppos)) {
         stmts.set(ppos);
         queue.push(ppos);
       }
@@ -309,14 +325,19 @@ void MirFuncContext::identify_loops(void)
 
       for (auto ppos : stmt_info[x].prev)
       {
-        if (stmts.get(ppos))
+        if (stmts.get(ppos) || !reachable.get(ppos))
           continue;
-        assert(ppos >= pos && ppos <= ppos_max);
+        if (ppos < pos || ppos > ppos_max)
+          return false;
         stmts.set(ppos);
         queue.push(ppos);
       }
     }
 
+    for (auto ppos : stmt_info[pos].prev)
+      if (ppos != pos - 1 && !stmts.get(ppos) && reachable.get(ppos))
+        return false;
+
     std::vector<unsigned int> tails;
     for (auto stmt : stmts)
       for (auto npos : stmt_info[stmt].next)
@@ -333,46 +354,120 @@ void MirFuncContext::identify_loops(void)
           }),
         tails.end());
 
-    assert(pos > 0);
+    if (pos == 0 || !func->stmts[pos - 1]->is_empty())
+      return false;
     stmts.set(pos - 1);
 
-    assert(func->stmts[pos - 1]->is_empty());
     for (auto tail : tails)
     {
-      assert(func->stmts[tail]->is_empty());
+      if (!func->stmts[tail]->is_empty())
+        return false;
       for (auto ppos : stmt_info[tail].prev)
-        assert(stmts.get(ppos));
+        if (!stmts.get(ppos) && reachable.get(ppos))
+          return false;
     }
 
     loops.emplace_back(std::move(stmts),
         std::vector<unsigned int>(), pos - 1, std::move(tails));
   }
 
+  return true;
+}
+
+bool MirFuncContext::check_loops(void)
+{
+  invalidate();
+  require(MirAnalysis::StmtInfo);
+
+  std::vector<MirLoop> loops;
+  return find_loops(loops);
+}
+
+void MirFuncContext::identify_loops(void)
+{
+  bool found = find_loops(loops);
+  assert(found);
+
+  std::vector<unsigned int> depth;
+  depth.resize(loops.size(), 0);
+
   for (size_t i = 1; i < loops.size(); ++i)
   {
     for (size_t j = i - 1; ~j; --j)
     {
       if (loops[j].stmts.contain(loops[i].stmts)) {
         loops[j].kids.emplace_back(i);
+        depth[i] = depth[j] + 1;
         break;
       }
     }
+
+    for (auto stmt : loops[i].stmts)
+      stmt_info[stmt].loop_depth = depth[i];
+    stmt_info[loops[i].head].loop_depth = depth[i] - 1;
+    for (auto tail : loops[i].tails)
+      stmt_info[tail].loop_depth = depth[i] - 1;
   }
 }
 
+unsigned long MirFuncContext::estimate_freq(unsigned int stmt) const
+{
+  if (stmt_counts.size() != 0)
+    return stmt_counts[stmt];
+
+  unsigned long freq = 1;
+  for (unsigned int i = 0; i < stmt_info[stmt].loop_depth && i < 9; ++i)
+    freq *= 10;
+  return freq;
+}
+
 void MirFuncContext::prepare(void)
 {
-  stmt_info.clear();
-  loops.clear();
+  invalidate();
+  require(MirAnalysis::Loops);
+}
+
+void MirFuncContext::require(MirAnalysis analysis)
+{
+  unsigned int mask = 1u << static_cast<unsigned int>(analysis);
+  if (valid_analyses & mask)
+    return;
 
-  fill_stmt_info();
-  identify_loops();
+  switch (analysis)
+  {
+  case MirAnalysis::StmtInfo:
+    stmt_info.clear();
+    fill_stmt_info();
+    break;
+  case MirAnalysis::Loops:
+    require(MirAnalysis::StmtInfo);
+    loops.clear();
+    identify_loops();
+    break;
+  case MirAnalysis::Idoms:
+    require(MirAnalysis::StmtInfo);
+    compute_idoms();
+    break;
+  }
+  valid_analyses |= mask;
+}
+
+void MirFuncContext::invalidate(void)
+{
+  valid_analyses = 0;
 }
 
 bool MirFuncContext::build_liveness_one(MirLocal local)
 {
   if (defs[local].size() == 0)
     return false;
+  if (local == 0 && leaf_func) {
+    for (const auto &def : defs[local])
+      reg_info[def.first][def.second] = Register::RA;
+    for (const auto &use : uses[local])
+      reg_info[use.first][use.second] = Register::RA;
+    return false;
+  }
   if (uses[local].size() == 0) {
     assert(local < func->num_args);
     reg_info[0][local + 1] = reg_from_arg_id(local);
@@ -689,6 +784,10 @@ use_next:;
     buf.emplace_back(std::move(stmts), ll.local,
         loop_index, hint, forbid, std::move(loop_uses[i]),
         std::move(loop_defs[i]), ll.remat);
+
+    for (auto split : ll.splits)
+      if (loops[loop_index].stmts.contain(loops[split].stmts))
+        buf.back().splits.emplace_back(split);
   }
 
   for (const auto &use : spilled_uses)
@@ -775,6 +874,153 @@ void MirFuncContext::spill_liveness_all(void)
     liveness.emplace_back(std::move(ll));
 }
 
+unsigned long MirFuncContext::estimate_spill_cost(
+    const MirLocalLiveness &ll) const
+{
+  if (ll.kids.size() != 0) {
+    unsigned long cost = 0;
+    for (const auto &kid : ll.kids)
+      cost += estimate_spill_cost(kid);
+    return cost;
+  }
+
+  const auto &loop_indices = loops[ll.loop].kids;
+  std::vector<unsigned int> loop_refs;
+  loop_refs.resize(loop_indices.size(), 0);
+
+  unsigned long cost = 0;
+  auto weigh = [&] (const MirOperand &operand, unsigned int ref) {
+    for (size_t i = 0; i < loop_indices.size(); ++i)
+    {
+      if (!loops[loop_indices[i]].stmts.get(operand.first))
+        continue;
+      loop_refs[i] |= ref;
+      return;
+    }
+    cost += estimate_freq(operand.first);
+  };
+
+  for (const auto &use : ll.get_uses(this))
+    weigh(use, 1);
+  for (const auto &def : ll.get_defs(this))
+    weigh(def, 2);
+
+  for (size_t i = 0; i < loop_indices.size(); ++i)
+  {
+    unsigned long freq = estimate_freq(loops[loop_indices[i]].head);
+    if (loop_refs[i] & 1)
+      cost += freq;
+    if (loop_refs[i] & 2)
+      cost += freq;
+  }
+
+  return cost;
+}
+
+void MirFuncContext::split_liveness_cross_func(void)
+{
+  std::vector<std::vector<MirLocal>> locals;
+  locals.resize(liveness.size());
+
+  for (size_t i = 0; i < liveness.size(); ++i)
+  {
+    if (liveness[i].kids.size() == 0) {
+      locals[i].emplace_back(liveness[i].local);
+    } else {
+      for (const auto &kid : liveness[i].kids)
+        locals[i].emplace_back(kid.local);
+    }
+  }
+
+  auto cross_func = [&] (size_t i, unsigned int stmt) {
+    if (!stmt_info[stmt].func_call)
+      return false;
+    if (!liveness[i].stmts.get(stmt))
+      return false;
+    if ((liveness[i].forbid & MASK_REG_CALLEE) == MASK_REG_CALLEE)
+      return false;
+    return std::find(locals[i].begin(), locals[i].end(),
+        stmt_info[stmt].def) == locals[i].end();
+  };
+
+  for (size_t loop = 1; loop < loops.size(); ++loop)
+  {
+    const auto &stmts = loops[loop].stmts;
+
+    unsigned int pressure = 0;
+    for (auto stmt : stmts)
+    {
+      if (!stmt_info[stmt].func_call)
+        continue;
+      unsigned int live = 0;
+      for (size_t i = 0; i < liveness.size(); ++i)
+        if (cross_func(i, stmt))
+          ++live;
+      if (live > pressure)
+        pressure = live;
+    }
+    if (pressure <= NR_REG_CALLEE)
+      continue;
+
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < liveness.size(); ++i)
+    {
+      if (!liveness[i].stmts.get(loops[loop].head))
+        continue;
+
+      bool crossed = false;
+      for (auto stmt : stmts)
+        crossed |= cross_func(i, stmt);
+      if (!crossed)
+        continue;
+
+      for (auto local : locals[i])
+      {
+        for (const auto &def : defs[local])
+          if (stmts.get(def.first))
+            goto next;
+        for (const auto &use : uses[local])
+          if (stmts.get(use.first))
+            goto next;
+      }
+      candidates.emplace_back(i);
+next:;
+    }
+
+    std::vector<unsigned long> cost;
+    for (auto i : candidates)
+      cost.emplace_back(liveness[i].remat ? 0 : estimate_spill_cost(liveness[i]));
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < candidates.size(); ++i)
+      order.emplace_back(i);
+    std::stable_sort(order.begin(), order.end(),
+        [&] (size_t x, size_t y) { return cost[x] < cost[y]; });
+    for (auto &i : order)
+      i = candidates[i];
+    candidates = std::move(order);
+    if (candidates.size() > pressure - NR_REG_CALLEE)
+      candidates.resize(pressure - NR_REG_CALLEE);
+
+    Bitset inner = stmts;
+    inner.clr(loops[loop].head);
+    for (auto tail : loops[loop].tails)
+      inner.clr(tail);
+
+    for (auto i : candidates)
+    {
+      liveness[i].stmts -= inner;
+      liveness[i].splits.emplace_back(loop);
+
+      bool crossed = false;
+      for (auto stmt : liveness[i].stmts)
+        crossed |= cross_func(i, stmt);
+      if (!crossed)
+        liveness[i].hint &= ~reg_hint_cross_func();
+    }
+  }
+}
+
 bool MirFuncContext::graph_try_color(void)
 {
   Graph graph(liveness.size());
@@ -793,8 +1039,13 @@ bool MirFuncContext::graph_try_color(void)
     }
   }
 
+  uint32_t reserved = leaf_func ? reg_forbid_leaf_func() : 0;
   for (size_t i = 0; i < liveness.size(); ++i)
-    degree[i] += __builtin_popcount(liveness[i].forbid);
+    degree[i] += __builtin_popcount(liveness[i].forbid | reserved);
+
+  std::vector<unsigned long> cost;
+  for (const auto &ll : liveness)
+    cost.emplace_back(ll.loop != ~0u ? estimate_spill_cost(ll) : 0);
 
   std::stack<unsigned int> stack;
   std::queue<unsigned int> queue;
@@ -849,13 +1100,17 @@ bool MirFuncContext::graph_try_color(void)
       if (deg_max >= NR_REGISTERS)
         break;
 
+      unsigned long cost_min = 0;
       for (size_t i = 0; i < liveness.size(); ++i)
       {
         if (liveness[i].loop == ~0u)
           continue;
-        if (degree[i] <= deg_max)
+        if (degree[i] < NR_REGISTERS)
+          continue;
+        if (deg_max && cost[i] * deg_max >= cost_min * degree[i])
           continue;
         deg_max = degree[i];
+        cost_min = cost[i];
         node = i;
       }
       assert(deg_max >= NR_REGISTERS);
@@ -876,7 +1131,7 @@ bool MirFuncContext::graph_try_color(void)
     assert(liveness[x].color == 0);
     assert(!liveness[x].to_spill);
 
-    uint32_t color = liveness[x].forbid;
+    uint32_t color = liveness[x].forbid | reserved;
     for (auto y : graph.adjacent(x))
       color |= liveness[y].color;
 
@@ -1022,7 +1277,8 @@ void MirFuncContext::spill_regs_cross_func(void)
 
   for (size_t i = 0; i < liveness.size(); ++i)
   {
-    if (liveness[i].color & MASK_REG_CALLEE)
+    bool caller_saved = !(liveness[i].color & MASK_REG_CALLEE);
+    if (!caller_saved && liveness[i].splits.size() == 0)
       continue;
     if (liveness[i].loop == ~0u)
       continue;
@@ -1035,7 +1291,7 @@ void MirFuncContext::spill_regs_cross_func(void)
 
     for (auto stmt : liveness[i].stmts)
     {
-      if (!stmt_info[stmt].func_call)
+      if (!caller_saved || !stmt_info[stmt].func_call)
         continue;
       loads.set(stmt);
       if (!liveness[i].remat)
@@ -1043,7 +1299,7 @@ void MirFuncContext::spill_regs_cross_func(void)
     }
 
     if (unsigned int loop = liveness[i].loop;
-        loop != ~0u && loop != 0) {
+        caller_saved && loop != ~0u && loop != 0) {
       if (liveness[i].stmts.get(loops[loop].head))
         loads.set(loops[loop].head);
       if (!liveness[i].remat)
@@ -1052,6 +1308,15 @@ void MirFuncContext::spill_regs_cross_func(void)
             stores.set(tail);
     }
 
+    for (auto loop : liveness[i].splits)
+    {
+      if (!liveness[i].remat)
+        stores.set(loops[loop].head);
+      for (auto tail : loops[loop].tails)
+        if (liveness[i].stmts.get(tail))
+          loads.set(tail);
+    }
+
     std::vector<MirLocal> locals;
     if (liveness[i].kids.size() == 0) {
       locals.emplace_back(liveness[i].local);
@@ -1083,7 +1348,7 @@ void MirFuncContext::spill_regs_cross_func(void)
             continue;
           if (!liveness[i].stmts.get(npos))
             continue;
-          if (stmt_info[npos].func_call)
+          if (caller_saved && stmt_info[npos].func_call)
             continue;
           mask.set(npos);
           queue.push(npos);
@@ -1116,7 +1381,7 @@ void MirFuncContext::spill_regs_cross_func(void)
               stmt_info[ppos].def) != locals.end())
           continue;
         mask.set(ppos);
-        if (stmt_info[ppos].func_call)
+        if (caller_saved && stmt_info[ppos].func_call)
           continue;
         queue.push(ppos);
       }
@@ -1156,6 +1421,8 @@ void MirFuncContext::spill_regs_cross_func(void)
       }
     }
 
+    stores -= loads;
+
     if (!liveness[i].remat && (stores || loads)) {
       if (auto it = spilled_locals.find(locals[0]);
           it == spilled_locals.end())
@@ -1189,6 +1456,257 @@ void MirFuncContext::finish_reg_alloc(void)
     finish_liveness(ll, ll.color);
 
   spill_regs_cross_func();
+  color_spill_slots();
+}
+
+void MirFuncContext::color_spill_slots(void)
+{
+  const size_t nr_stmts = stmt_info.size();
+
+  std::vector<std::pair<unsigned int, MirLocal>> slots;
+  for (const auto &[local, slot] : spilled_locals)
+    slots.emplace_back(slot, local);
+  std::sort(slots.begin(), slots.end());
+
+  std::unordered_map<MirLocal, unsigned int> indices;
+  for (size_t i = 0; i < slots.size(); ++i)
+    indices[slots[i].second] = i;
+
+  std::vector<Bitset> loads, stores;
+  loads.resize(slots.size(), Bitset(nr_stmts));
+  stores.resize(slots.size(), Bitset(nr_stmts));
+
+  for (const auto &[stmt, ops] : spill_loads)
+    for (const auto &op : ops)
+      if (auto it = indices.find(op->get_slot()); it != indices.end())
+        loads[it->second].set(stmt);
+  for (const auto &[stmt, ops] : spill_stores)
+    for (const auto &op : ops)
+      if (auto it = indices.find(op->get_slot()); it != indices.end())
+        stores[it->second].set(stmt);
+
+  std::vector<Bitset> occupied;
+  for (size_t i = 0; i < slots.size(); ++i)
+  {
+    Bitset stored = stores[i];
+    std::queue<unsigned int> queue;
+
+    for (auto stmt : stores[i])
+      queue.push(stmt);
+    while (!queue.empty())
+    {
+      unsigned int pos = queue.front();
+      queue.pop();
+      for (auto npos : stmt_info[pos].next)
+      {
+        if (stored.get(npos))
+          continue;
+        stored.set(npos);
+        queue.push(npos);
+      }
+    }
+
+    Bitset live = loads[i];
+    live |= stores[i];
+    for (auto stmt : loads[i])
+      queue.push(stmt);
+    while (!queue.empty())
+    {
+      unsigned int pos = queue.front();
+      queue.pop();
+      for (auto ppos : stmt_info[pos].prev)
+      {
+        if (live.get(ppos) || !stored.get(ppos))
+          continue;
+        live.set(ppos);
+        if (!stores[i].get(ppos))
+          queue.push(ppos);
+      }
+    }
+
+    unsigned int color = 0;
+    while (color < occupied.size() && occupied[color].test(live))
+      ++color;
+    if (color == occupied.size())
+      occupied.emplace_back(nr_stmts);
+    occupied[color] |= live;
+    spilled_locals[slots[i].second] = color;
+  }
+
+  num_spill_slots = occupied.size();
+}
+
+void MirFuncContext::shrink_wrap(void)
+{
+  const unsigned int exit = stmt_info.size() - 1;
+
+  if (get_frame_size() == 0 || get_frame_size() > 2047)
+    return;
+  if (get_spill_stores(0).size() != 0
+      || get_spill_stores(exit).size() != 0
+      || get_spill_loads(exit).size() != 0)
+    return;
+
+  Bitset reachable = calc_reachable();
+  const std::vector<unsigned int> &idoms = calc_idoms();
+
+  std::vector<unsigned int> depth;
+  depth.resize(stmt_info.size(), 0);
+  for (auto stmt : reachable)
+    for (unsigned int x = stmt; x != 0; x = idoms[x])
+      ++depth[stmt];
+
+  unsigned int pos = ~0u;
+  for (auto stmt : reachable)
+  {
+    if (stmt == exit)
+      continue;
+    if (!stmt_info[stmt].func_call
+        && !func->stmts[stmt]->is_stack_addr()
+        && get_spill_loads(stmt).size() == 0
+        && get_spill_stores(stmt).size() == 0)
+      continue;
+    if (pos == ~0u) {
+      pos = stmt;
+      continue;
+    }
+    unsigned int x = stmt;
+    while (pos != x)
+    {
+      if (depth[pos] > depth[x])
+        pos = idoms[pos];
+      else
+        x = idoms[x];
+    }
+  }
+
+  std::vector<Bitset> occupied;
+  occupied.resize(NR_REGISTERS, Bitset(stmt_info.size()));
+  std::vector<uint32_t> forbid;
+  forbid.resize(NR_REGISTERS, 0);
+
+  for (const auto &ll : liveness)
+  {
+    unsigned int regid = __builtin_ctz(ll.color);
+    occupied[regid] |= ll.stmts;
+    forbid[regid] |= ll.forbid;
+  }
+  for (auto stmt : reachable)
+    for (auto reg : reg_info[stmt])
+      if (reg < Register::TP)
+        occupied[static_cast<unsigned int>(reg)].set(stmt);
+
+  for (; pos != ~0u && pos > 1; pos = idoms[pos])
+  {
+    if (stmt_info[pos].loop_depth != 0)
+      continue;
+
+    Bitset region(stmt_info.size());
+    std::queue<unsigned int> queue;
+    region.set(pos);
+    queue.push(pos);
+
+    while (!queue.empty())
+    {
+      unsigned int x = queue.front();
+      queue.pop();
+      for (auto npos : stmt_info[x].next)
+      {
+        if (region.get(npos))
+          continue;
+        region.set(npos);
+        queue.push(npos);
+      }
+    }
+
+    Bitset bare = reachable;
+    bare -= region;
+
+    bool ok = true;
+    for (auto ppos : stmt_info[pos].prev)
+      ok &= bare.get(ppos);
+    for (auto stmt : region)
+    {
+      if (stmt == pos || stmt == exit)
+        continue;
+      for (auto ppos : stmt_info[stmt].prev)
+        ok &= !bare.get(ppos);
+    }
+    if (!ok)
+      continue;
+
+    std::vector<Register> exits;
+    exits.resize(stmt_info.size(), Register::UND);
+    for (auto ppos : stmt_info[exit].prev)
+    {
+      if (!bare.get(ppos))
+        continue;
+      const auto &next = stmt_info[ppos].next;
+      if (func->stmts[ppos]->is_return()
+          || (ppos + 1 == exit && next[0] == exit
+            && (next.size() == 1 ? !func->stmts[ppos]->maybe_jump()
+              : next[1] != exit)))
+        exits[ppos] = reg_info[exit][1];
+      else
+        ok = false;
+    }
+    if (!ok || std::count(exits.begin(), exits.end(), Register::UND)
+        == static_cast<long>(exits.size()))
+      break;
+
+    std::vector<std::pair<Register, Register>> moves;
+    std::vector<Register> renames;
+    renames.resize(NR_REGISTERS, Register::UND);
+
+    for (unsigned int i = NR_REG_CALLER; i < NR_REGISTERS; ++i)
+    {
+      Bitset needed = occupied[i];
+      needed &= bare;
+      for (auto stmt : bare)
+        for (auto reg : reg_info[stmt])
+          if (reg == static_cast<Register>(i))
+            needed.set(stmt);
+      if (!needed)
+        continue;
+
+      unsigned int j = static_cast<unsigned int>(Register::T1);
+      for (; j < NR_REG_CALLER; ++j)
+        if (!(forbid[i] & (1u << j)) && !occupied[j].test(needed))
+          break;
+      if (j == NR_REG_CALLER) {
+        ok = false;
+        break;
+      }
+
+      occupied[j] |= needed;
+      renames[i] = static_cast<Register>(j);
+
+      for (auto ppos : stmt_info[pos].prev)
+      {
+        if (!bare.get(ppos) || !occupied[i].get(ppos))
+          continue;
+        moves.emplace_back(static_cast<Register>(i), renames[i]);
+        break;
+      }
+    }
+    if (!ok)
+      break;
+
+    for (auto stmt : bare)
+      for (auto &reg : reg_info[stmt])
+        if (reg != Register::UND && reg < Register::TP
+            && renames[static_cast<unsigned int>(reg)] != Register::UND)
+          reg = renames[static_cast<unsigned int>(reg)];
+    for (auto &reg : exits)
+      if (reg != Register::UND && reg < Register::TP
+          && renames[static_cast<unsigned int>(reg)] != Register::UND)
+        reg = renames[static_cast<unsigned int>(reg)];
+
+    prologue_pos = pos;
+    prologue_moves = std::move(moves);
+    frameless_exits = std::move(exits);
+    break;
+  }
 }
 
 void MirFuncContext::reg_alloc(void)
@@ -1196,8 +1714,22 @@ void MirFuncContext::reg_alloc(void)
   fill_defs_and_uses();
   build_liveness_all();
 
-  while (!graph_try_color())
-    spill_liveness_all();
+  if (leaf_func && !graph_try_color()) {
+    leaf_func = false;
+    defs.clear();
+    uses.clear();
+    liveness.clear();
+    reg_info.clear();
+    fill_defs_and_uses();
+    build_liveness_all();
+  }
+
+  if (!leaf_func) {
+    split_liveness_cross_func();
+    while (!graph_try_color())
+      spill_liveness_all();
+  }
 
   finish_reg_alloc();
+  shrink_wrap();
 }
@@ -0,0 +1,61 @@
+#include "target.h"
+
+static const struct
+{
+  const char *name;
+  MirExtension ext;
+} g_extensions[] = {
+  { "zba", MirExtension::Zba },
+  { "zbb", MirExtension::Zbb },
+  { "zicond", MirExtension::Zicond },
+};
+
+bool MirTarget::set_march(const std::string &march)
+{
+  extensions = 0;
+  error.clear();
+
+  if (march.compare(0, 6, "rv32im") != 0
+      || (march.size() > 6 && march[6] != '_')) {
+    error = "unsupported architecture `" + march + "`";
+    return false;
+  }
+
+  size_t pos = 7;
+  while (pos < march.size())
+  {
+    size_t end = march.find('_', pos);
+    if (end == std::string::npos)
+      end = march.size();
+
+    std::string name = march.substr(pos, end - pos);
+    bool found = false;
+    for (const auto &ext : g_extensions)
+    {
+      if (name == ext.name) {
+        extensions |= 1u << static_cast<unsigned int>(ext.ext);
+        found = true;
+      }
+    }
+    if (!found) {
+      error = "unsupported extension `" + name + "`";
+      return false;
+    }
+    pos = end + 1;
+  }
+
+  return true;
+}
+
+bool MirTarget::set_small_data(const std::string &limit)
+{
+  error.clear();
+  if (limit.empty() || limit.size() > 9
+      || limit.find_first_not_of("0123456789") != std::string::npos) {
+    error = "invalid small data limit `" + limit + "`";
+    return false;
+  }
+
+  small_data_limit = std::stoul(limit);
+  return true;
+}
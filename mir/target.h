@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+
+enum class MirExtension
+{
+  Zba,
+  Zbb,
+  Zicond,
+};
+
+class MirTarget
+{
+public:
+  MirTarget(void)
+    : extensions(0), small_data_limit(8), error()
+  {}
+
+  bool set_march(const std::string &march);
+  bool set_small_data(const std::string &limit);
+
+  bool has_extension(MirExtension ext) const
+  {
+    return (extensions >> static_cast<unsigned int>(ext)) & 1;
+  }
+
+  /* Whether an object of `bytes` bytes goes into the small sections. */
+  bool is_small_data(size_t bytes) const
+  {
+    return bytes <= small_data_limit;
+  }
+
+  const std::string &get_error(void) const
+  {
+    return error;
+  }
+
+private:
+  unsigned int extensions;
+  unsigned int small_data_limit;
+  std::string error;
+};
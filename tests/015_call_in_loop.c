@@ -0,0 +1,40 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+extern int data[];
+
+int pressure(int n);
+
+static int expected(int n)
+{
+  int r = 0;
+  for (int t = 0; t < n; ++t)
+  {
+    int a0 = data[t], a1 = data[t + 1], a2 = data[t + 2], a3 = data[t + 3];
+    int b0 = a0 * a1, b1 = a1 * a2, b2 = a2 * a3, b3 = a3 * a0;
+    int c0 = b0 + b1, c1 = b1 + b2, c2 = b2 + b3, c3 = b3 + b0;
+    int d0 = c0 - a0, d1 = c1 - a1, d2 = c2 - a2, d3 = c3 - a3;
+    int e0 = d0 * b2, e1 = d1 * b3, e2 = d2 * b0, e3 = d3 * b1;
+    for (int k = 0; k < 8; ++k)
+      r += (e0 + k) * 31 + e1 + e2 * c0 + e3 * c1
+        + d0 * c2 + d1 * c3 + d2 + d3 + a0 + b0;
+  }
+  return r;
+}
+
+int main(void)
+{
+  for (int i = 0; i < 64; ++i)
+    data[i] = i * i % 7;
+
+  assert(pressure(0) == 0);
+  assert(pressure(1) == expected(1));
+  assert(pressure(60) == expected(60));
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
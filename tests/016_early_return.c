@@ -0,0 +1,36 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+int count(int n);
+int walk(int a, int b, int c);
+int steps(int n, int k);
+
+static int expected_walk(int a, int b, int c)
+{
+  int s = a * b + c;
+  if (a <= 0)
+    return b > c ? s : s - b;
+  return expected_walk(a - 1, c, b) + s;
+}
+
+int main(void)
+{
+  assert(count(0) == 0);
+  assert(count(1) == 1);
+  assert(count(20) == 6765);
+
+  assert(walk(0, 5, 3) == 8);
+  assert(walk(0, 3, 5) == 2);
+  assert(walk(7, 4, 9) == expected_walk(7, 4, 9));
+  assert(walk(8, 9, 4) == expected_walk(8, 9, 4));
+
+  assert(steps(50, 7) == 7);
+  assert(steps(350, 7) == 7 + 50 / 7 + 150 / 7 + 250 / 7);
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,163 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+extern int g;
+
+int phases(int v[]);
+
+static int expected(int v[])
+{
+  int x0 = v[0] * 1;
+  int x1 = v[3] * 2;
+  int x2 = v[6] * 3;
+  int x3 = v[9] * 4;
+  int x4 = v[12] * 5;
+  int x5 = v[15] * 6;
+  int x6 = v[18] * 7;
+  int x7 = v[21] * 8;
+  int x8 = v[24] * 9;
+  int x9 = v[27] * 10;
+  int x10 = v[30] * 11;
+  int x11 = v[1] * 12;
+  int x12 = v[4] * 13;
+  int x13 = v[7] * 14;
+  int x14 = v[10] * 15;
+  int x15 = v[13] * 16;
+  int x16 = v[16] * 17;
+  int x17 = v[19] * 18;
+  int x18 = v[22] * 19;
+  int x19 = v[25] * 20;
+  int x20 = v[28] * 21;
+  int x21 = v[31] * 22;
+  int x22 = v[2] * 23;
+  int x23 = v[5] * 24;
+  int x24 = v[8] * 25;
+  int x25 = v[11] * 26;
+  int x26 = v[14] * 27;
+  int x27 = v[17] * 28;
+  int x28 = v[20] * 29;
+  int x29 = v[23] * 30;
+  int x30 = v[26] * 31;
+  int x31 = v[29] * 32;
+  ++g;
+  int x_sum = 0;
+  x_sum = x_sum % 997 * 3 + x0 - x5;
+  x_sum = x_sum % 997 * 3 + x1 - x6;
+  x_sum = x_sum % 997 * 3 + x2 - x7;
+  x_sum = x_sum % 997 * 3 + x3 - x8;
+  x_sum = x_sum % 997 * 3 + x4 - x9;
+  x_sum = x_sum % 997 * 3 + x5 - x10;
+  x_sum = x_sum % 997 * 3 + x6 - x11;
+  x_sum = x_sum % 997 * 3 + x7 - x12;
+  x_sum = x_sum % 997 * 3 + x8 - x13;
+  x_sum = x_sum % 997 * 3 + x9 - x14;
+  x_sum = x_sum % 997 * 3 + x10 - x15;
+  x_sum = x_sum % 997 * 3 + x11 - x16;
+  x_sum = x_sum % 997 * 3 + x12 - x17;
+  x_sum = x_sum % 997 * 3 + x13 - x18;
+  x_sum = x_sum % 997 * 3 + x14 - x19;
+  x_sum = x_sum % 997 * 3 + x15 - x20;
+  x_sum = x_sum % 997 * 3 + x16 - x21;
+  x_sum = x_sum % 997 * 3 + x17 - x22;
+  x_sum = x_sum % 997 * 3 + x18 - x23;
+  x_sum = x_sum % 997 * 3 + x19 - x24;
+  x_sum = x_sum % 997 * 3 + x20 - x25;
+  x_sum = x_sum % 997 * 3 + x21 - x26;
+  x_sum = x_sum % 997 * 3 + x22 - x27;
+  x_sum = x_sum % 997 * 3 + x23 - x28;
+  x_sum = x_sum % 997 * 3 + x24 - x29;
+  x_sum = x_sum % 997 * 3 + x25 - x30;
+  x_sum = x_sum % 997 * 3 + x26 - x31;
+  x_sum = x_sum % 997 * 3 + x27 - x0;
+  x_sum = x_sum % 997 * 3 + x28 - x1;
+  x_sum = x_sum % 997 * 3 + x29 - x2;
+  x_sum = x_sum % 997 * 3 + x30 - x3;
+  x_sum = x_sum % 997 * 3 + x31 - x4;
+  v[0] = x_sum;
+  int y0 = v[0] * 1;
+  int y1 = v[5] * 2;
+  int y2 = v[10] * 3;
+  int y3 = v[15] * 4;
+  int y4 = v[20] * 5;
+  int y5 = v[25] * 6;
+  int y6 = v[30] * 7;
+  int y7 = v[3] * 8;
+  int y8 = v[8] * 9;
+  int y9 = v[13] * 10;
+  int y10 = v[18] * 11;
+  int y11 = v[23] * 12;
+  int y12 = v[28] * 13;
+  int y13 = v[1] * 14;
+  int y14 = v[6] * 15;
+  int y15 = v[11] * 16;
+  int y16 = v[16] * 17;
+  int y17 = v[21] * 18;
+  int y18 = v[26] * 19;
+  int y19 = v[31] * 20;
+  int y20 = v[4] * 21;
+  int y21 = v[9] * 22;
+  int y22 = v[14] * 23;
+  int y23 = v[19] * 24;
+  int y24 = v[24] * 25;
+  int y25 = v[29] * 26;
+  int y26 = v[2] * 27;
+  int y27 = v[7] * 28;
+  int y28 = v[12] * 29;
+  int y29 = v[17] * 30;
+  int y30 = v[22] * 31;
+  int y31 = v[27] * 32;
+  ++g;
+  int y_sum = 0;
+  y_sum = y_sum % 997 * 3 + y0 - y5;
+  y_sum = y_sum % 997 * 3 + y1 - y6;
+  y_sum = y_sum % 997 * 3 + y2 - y7;
+  y_sum = y_sum % 997 * 3 + y3 - y8;
+  y_sum = y_sum % 997 * 3 + y4 - y9;
+  y_sum = y_sum % 997 * 3 + y5 - y10;
+  y_sum = y_sum % 997 * 3 + y6 - y11;
+  y_sum = y_sum % 997 * 3 + y7 - y12;
+  y_sum = y_sum % 997 * 3 + y8 - y13;
+  y_sum = y_sum % 997 * 3 + y9 - y14;
+  y_sum = y_sum % 997 * 3 + y10 - y15;
+  y_sum = y_sum % 997 * 3 + y11 - y16;
+  y_sum = y_sum % 997 * 3 + y12 - y17;
+  y_sum = y_sum % 997 * 3 + y13 - y18;
+  y_sum = y_sum % 997 * 3 + y14 - y19;
+  y_sum = y_sum % 997 * 3 + y15 - y20;
+  y_sum = y_sum % 997 * 3 + y16 - y21;
+  y_sum = y_sum % 997 * 3 + y17 - y22;
+  y_sum = y_sum % 997 * 3 + y18 - y23;
+  y_sum = y_sum % 997 * 3 + y19 - y24;
+  y_sum = y_sum % 997 * 3 + y20 - y25;
+  y_sum = y_sum % 997 * 3 + y21 - y26;
+  y_sum = y_sum % 997 * 3 + y22 - y27;
+  y_sum = y_sum % 997 * 3 + y23 - y28;
+  y_sum = y_sum % 997 * 3 + y24 - y29;
+  y_sum = y_sum % 997 * 3 + y25 - y30;
+  y_sum = y_sum % 997 * 3 + y26 - y31;
+  y_sum = y_sum % 997 * 3 + y27 - y0;
+  y_sum = y_sum % 997 * 3 + y28 - y1;
+  y_sum = y_sum % 997 * 3 + y29 - y2;
+  y_sum = y_sum % 997 * 3 + y30 - y3;
+  y_sum = y_sum % 997 * 3 + y31 - y4;
+  return y_sum + v[0];
+}
+
+int main(void)
+{
+  int v[32], w[32];
+  for (int i = 0; i < 32; ++i)
+    v[i] = w[i] = i * 7 % 13 - 6;
+
+  int r = phases(v);
+  assert(g == 2);
+  assert(r == expected(w));
+  assert(v[0] == w[0]);
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
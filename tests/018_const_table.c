@@ -0,0 +1,29 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+extern const int primes[];
+
+int pick(int k);
+int sum(int n);
+
+int main(void)
+{
+  static const int w[3][2] = {{1, 2}, {3, 0}, {5, 6}};
+
+  for (int k = 0; k < 8; ++k)
+    assert(pick(k) == 5 * 8 + 5 + 4 + primes[k]);
+
+  for (int n = 0; n <= 8; ++n) {
+    int s = 0;
+    for (int i = 0; i < n; ++i)
+      s += primes[i] * w[i % 3][i % 2];
+    assert(sum(n) == s + 5);
+  }
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
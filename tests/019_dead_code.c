@@ -0,0 +1,41 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+extern int g;
+
+int dead_loop(int n);
+int diamond(int a, int b);
+int const_branch(int a);
+int early_exit(int n);
+int chain(int a);
+
+int main(void)
+{
+  for (int n = -3; n < 100; ++n)
+    assert(dead_loop(n) == n + 1);
+
+  g = 0;
+  assert(diamond(5, 3) == 2 && g == 1);
+  assert(diamond(2, -7) == 9 && g == 1);
+  assert(diamond(-4, 6) == -10 && g == 2);
+
+  for (int a = -5; a < 5; ++a)
+    assert(const_branch(a) == a + 1);
+
+  for (int n = -2; n < 10; ++n)
+    assert(early_exit(n) == (n > 2 ? n : -1));
+
+  for (int a = -1; a < 30; ++a) {
+    int s = 0;
+    for (int i = a; i > 0; --i)
+      s += i % 2 == 0 ? i % 3 == 0 : 2;
+    assert(chain(a) == s);
+  }
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
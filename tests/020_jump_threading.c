@@ -0,0 +1,31 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+int correlated(int a, int b, int c);
+int find_square(int n, int sq);
+int repeated(int x);
+
+int main(void)
+{
+  for (int a = -3; a < 4; ++a)
+    for (int b = -3; b < 4; ++b)
+      for (int c = -1; c < 5; ++c)
+        assert(correlated(a, b, c) ==
+            (a < b && c > 0) + (a < b) * 2 + (a >= b || c == 3) * 4);
+
+  for (int n = -2; n < 12; ++n) {
+    assert(find_square(n, 49) == (n > 7 ? 7 : -1));
+    assert(find_square(n, 0) == (n > 0 ? 0 : -1));
+    assert(find_square(n, 5) == -1);
+  }
+
+  for (int x = -2; x < 5; ++x)
+    assert(repeated(x) == (x == 1 ? 10 : x == 2 ? 20 : 40));
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
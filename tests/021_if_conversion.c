@@ -0,0 +1,29 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+int min(int a, int b);
+int abs(int a);
+int clamp(int x, int lo, int hi);
+int select_eq(int a, int b);
+int sort_pair(int a, int b);
+
+int main(void)
+{
+  for (int a = -20; a < 20; ++a) {
+    assert(abs(a) == (a < 0 ? -a : a));
+    assert(clamp(a, -5, 7) == (a < -5 ? -5 : a > 7 ? 7 : a));
+    for (int b = -20; b < 20; b += 3) {
+      assert(min(a, b) == (a < b ? a : b));
+      assert(select_eq(a, b) == (a == b ? a + 7 : 3));
+      assert(sort_pair(a, b) ==
+          (a < b ? a * 1000 + b : b * 1000 + a));
+    }
+  }
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
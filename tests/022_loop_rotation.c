@@ -0,0 +1,39 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+int poll(int n);
+int search(int a[], int n, int x);
+int either(int n, int m);
+int skip_odd(int n);
+
+int main(void)
+{
+  int a[] = { 5, 3, 8, 3, 1 };
+
+  for (int n = -2; n < 6; ++n)
+    assert(poll(n) == (n > 0 ? n : 0) * 101 + 1);
+
+  assert(search(a, 5, 5) == 0);
+  assert(search(a, 5, 3) == 1);
+  assert(search(a, 5, 1) == 4);
+  assert(search(a, 5, 7) == 5);
+  assert(search(a, 0, 5) == 0);
+
+  for (int n = -2; n < 4; ++n)
+    for (int m = -2; m < 4; ++m)
+      assert(either(n, m) == (n > m ? (n > 0 ? n : 0) : (m > 0 ? m : 0)));
+
+  for (int n = -1; n < 60; ++n) {
+    int s = 0;
+    for (int i = 2; i <= n && i <= 50; i += 2)
+      s += i;
+    assert(skip_odd(n) == s);
+  }
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+int checked_sum(int a[], int n);
+int classify(int x);
+int gcd(int a, int b);
+int count_hits(int n, int m);
+
+int main(void)
+{
+  int a[] = { 4, 7, 1, -3, 9 };
+
+  assert(checked_sum(a, 0) == 0);
+  assert(checked_sum(a, 3) == 12);
+  assert(checked_sum(a, 5) == -1);
+
+  assert(classify(0) == 0);
+  assert(classify(5) == 1);
+  assert(classify(101) == 2);
+  assert(classify(-7) == -1);
+  assert(classify(-101) == -2);
+
+  assert(gcd(12, 18) == 6);
+  assert(gcd(7, 0) == 7);
+  assert(gcd(-4, 6) == 4);
+
+  assert(count_hits(0, 3) == 0);
+  assert(count_hits(10, 3) == 4);
+  assert(count_hits(5000, 1) == 1001);
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+int find_pair(int a[], int n, int sum);
+int ladder(int x);
+int skip_rows(int n);
+
+int main(void)
+{
+  int a[] = { 3, 9, 4, 7, 1 };
+
+  assert(find_pair(a, 5, 13) == 102);
+  assert(find_pair(a, 5, 8) == 304);
+  assert(find_pair(a, 5, 10) == 3);
+  assert(find_pair(a, 5, 11) == 203);
+  assert(find_pair(a, 5, 100) == -1);
+  assert(find_pair(a, 1, 3) == -1);
+
+  for (int x = -3; x < 40; ++x) {
+    int r = x < 5 ? 1 : x < 10 ? 2 : x < 20 ? 3
+      : x < 30 ? (x % 2 == 0 ? 4 : 5) : 6;
+    assert(ladder(x) == r * 10 + x % 3);
+  }
+
+  for (int n = 0; n < 20; ++n) {
+    int s = 0;
+    for (int i = 1; i <= n; ++i) {
+      if (i % 3 == 0)
+        continue;
+      for (int j = 1; j <= i; ++j) {
+        if (j % 2 == 0)
+          continue;
+        if (j > 7)
+          break;
+        s += j;
+      }
+    }
+    assert(skip_rows(n) == s);
+  }
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+int spill_calls(int n);
+int window(int a[], int i);
+int swap_steps(int n);
+
+static int mix(int a, int b, int c, int d)
+{
+  return a * 1000 + b * 100 + c * 10 + d;
+}
+
+int main(void)
+{
+  int a[16];
+
+  for (int n = -5; n < 5; ++n) {
+    int x0 = n + 1, x1 = n + 2, x2 = n + 3, x3 = n + 4;
+    int x4 = n + 5, x5 = n + 6, x6 = n + 7, x7 = n + 8;
+    int s = mix(x0, x1, x2, x3) + mix(x4, x5, x6, x7)
+      + mix(x1, x3, x5, x7) - mix(x0, x2, x4, x6);
+    assert(spill_calls(n) == s + x0 * x7 - x3 * x4);
+  }
+
+  for (int k = 0; k < 16; ++k)
+    a[k] = k * k - 20;
+  for (int i = 0; i < 8; ++i) {
+    int b[12] = { a[i], 1, 2, a[i + 1], 4000, 5, 0, 0, -7, a[11 - i] };
+    int s = 0;
+    for (int k = 0; k < 12; ++k)
+      s = s * 3 + b[k];
+    assert(window(a, i) == s - 1234);
+  }
+
+  for (int n = 0; n < 10; ++n) {
+    int p = 1, q = 2;
+    for (int i = 0; i < n; ++i) {
+      int t = p;
+      p = q;
+      q = t + 3000;
+    }
+    assert(swap_steps(n) == p * 7 + q);
+  }
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+int dot(int a[], int b[], int n);
+int rotate(int a[], int n);
+int poly(int x, int y);
+
+int main(void)
+{
+  int a[] = { 1, -2, 3, 4, 5, -6, 7, 8 };
+  int b[] = { 9, 8, -7, 6, 5, 4, 3, -2 };
+  int c[] = { 4, 5, 6, 7, 8 };
+
+  assert(dot(a, b, 0) == 0);
+  assert(dot(a, b, 2) == -7);
+  assert(dot(a, b, 8) == 2);
+
+  assert(rotate(c, 5) == 54);
+  assert(c[0] == 5 && c[1] == 6 && c[2] == 7 && c[3] == 8 && c[4] == 4);
+  assert(rotate(c, 1) == 55);
+
+  for (int x = -20; x <= 20; x += 3)
+    for (int y = -9; y <= 9; y += 2) {
+      int q = x / 7, r = y % 5;
+      int p = x * x * 3 + x * y - y * y;
+      assert(poly(x, y) == p + q * r - p / (r + 6));
+    }
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
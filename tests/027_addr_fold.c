@@ -0,0 +1,35 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+int stencil(int a[], int b[], int n);
+int fill_grid(int k);
+int local_window(int x);
+
+extern int grid[6][8];
+
+int main(void)
+{
+  int a[] = { 3, -1, 4, 1, -5, 9, 2, 6 };
+  int b[8] = { 0 };
+
+  assert(stencil(a, b, 2) == 0);
+  assert(stencil(a, b, 8) == 48);
+  assert(b[1] == 5 && b[3] == 1 && b[6] == 19);
+
+  assert(fill_grid(3) == 110);
+  assert(grid[0][7] == 21 && grid[1][7] == 21 && grid[5][6] == 46);
+  assert(grid[2][0] == 10 && grid[3][4] == 32);
+
+  for (int x = 0; x < 25; ++x) {
+    int w3 = (x + 2) + (x + 4), w9 = x - (x + 8);
+    int wx = x % 10 == 3 ? w3 : x % 10 == 9 ? w9 : x + x % 10;
+    assert(local_window(x) == w3 * 100 + w9 + wx);
+  }
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+int probe(int x);
+int run(int n);
+int swap_pair(void);
+
+extern int hits, misses, limit;
+extern int table[64];
+
+int main(void)
+{
+  assert(probe(3) == 1 && hits == 1 && misses == 0);
+  assert(probe(4) == 0 && hits == 1 && misses == 1);
+
+  hits = misses = 0;
+  limit = 4;
+  assert(run(10) == 3 * 100 + 7 * 10);
+  assert(table[0] == 1 && table[3] == 1 && table[4] == 2 && table[9] == 3);
+
+  assert(swap_pair() == 75);
+  assert(swap_pair() == 57);
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+int lookup(int x);
+int zeroed(int k);
+void fill(int a[], int n, int v);
+void copy_scaled(int dst[], int src[], int n);
+
+int main(void)
+{
+  static const int primes[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37,
+    41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109,
+    113 };
+  int a[40], b[40];
+
+  for (int x = 0; x < 80; ++x) {
+    int i = x % 36;
+    int v = i < 30 ? primes[i] : i == 30 ? x
+      : i == 31 || i == 35 ? 0 : 31 - i;
+    assert(lookup(x) == v + x * 1000);
+  }
+
+  for (int k = 0; k < 300; k += 37)
+    assert(zeroed(k) == k * (k + 1));
+
+  for (int n = 0; n < 40; ++n) {
+    for (int i = 0; i < 40; ++i)
+      a[i] = -1;
+    fill(a, n, n);
+    for (int i = 0; i < 40; ++i)
+      assert(a[i] == (i < n ? n : -1));
+  }
+
+  for (int n = 0; n < 40; ++n) {
+    for (int i = 0; i < 40; ++i)
+      a[i] = i, b[i] = 7;
+    copy_scaled(b, a, n);
+    for (int i = 0; i < 40; ++i)
+      assert(b[i] == (i >= 2 && i < n ? (i - 2) * 3 + i : 7));
+  }
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
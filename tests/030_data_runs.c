@@ -0,0 +1,34 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+int weight(int i);
+int step(int i, int j);
+int checksum();
+
+int main(void)
+{
+  int table[64] = {
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 1, 2, 3, 4,
+    4, 4, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0, -7, -7, -7, -7,
+    -7, 5, 0, 6, 6, 6, 6
+  };
+  int steps[2][8] = {{3, 3, 3, 3, 3}, {1, 2, 2, 2, 2, 2, 2, 2}};
+  int s = 0;
+
+  for (int i = 0; i < 64; ++i) {
+    assert(weight(i) == table[i]);
+    s = s * 31 + table[i];
+  }
+  assert(checksum() == s);
+
+  for (int i = 0; i < 2; ++i)
+    for (int j = 0; j < 8; ++j)
+      assert(step(i, j) == steps[i][j]);
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifdef __SYSY_TEST__
+
+#include <stdio.h>
+#include <assert.h>
+
+void col_add(int m[][40], int n);
+void col_prefix(int m[][40], int n);
+void col_skew(int m[][40], int n);
+int transpose();
+int get_dst(int i, int j);
+
+static void fill(int m[][40], int expect[][40])
+{
+  for (int i = 0; i < 40; ++i)
+    for (int j = 0; j < 40; ++j)
+      m[i][j] = expect[i][j] = (i * 37 + j * 11) % 23 - 7;
+}
+
+static void check(int m[][40], int expect[][40])
+{
+  for (int i = 0; i < 40; ++i)
+    for (int j = 0; j < 40; ++j)
+      assert(m[i][j] == expect[i][j]);
+}
+
+int main(void)
+{
+  static int m[40][40], expect[40][40];
+
+  fill(m, expect);
+  col_add(m, 30);
+  for (int j = 0; j < 30; ++j)
+    for (int i = 0; i < 30; ++i)
+      expect[i][j] = expect[i][j] + i * 2 - j;
+  check(m, expect);
+
+  fill(m, expect);
+  col_prefix(m, 40);
+  for (int j = 0; j < 40; ++j)
+    for (int i = 1; i < 40; ++i)
+      expect[i][j] = expect[i - 1][j] + expect[i][j];
+  check(m, expect);
+
+  fill(m, expect);
+  col_skew(m, 40);
+  for (int j = 1; j < 40; ++j)
+    for (int i = 0; i < 39; ++i)
+      expect[i][j] = expect[i + 1][j - 1] + 1;
+  check(m, expect);
+
+  assert(transpose() == 160);
+  for (int i = 0; i < 72; ++i)
+    for (int j = 0; j < 160; ++j)
+      assert(get_dst(i, j) == (j * 72 + i) * 3);
+
+  puts(__FILE__ " passed");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,113 @@
+#pragma once
+#include <cassert>
+#include <vector>
+#include <algorithm>
+
+/* Shortest stretch of equal words kept as a repeated run. */
+#define DATA_RUN_MIN_REPEAT  4
+
+/*
+ * `count` words starting at word `index`. A repeated run holds `value`
+ * in every word; otherwise the words are stored contiguously in the
+ * owning DataRuns, starting at position `value`.
+ */
+struct DataRun
+{
+  unsigned int index;
+  unsigned int count;
+  bool repeat;
+  int value;
+};
+
+/*
+ * Initial contents of an array, as runs in increasing order of index.
+ * Words not covered by any run are zero.
+ */
+class DataRuns
+{
+public:
+  typedef std::vector<DataRun>::const_iterator const_iterator;
+
+  /* Appends word `index`, which follows all words appended so far. */
+  void append(unsigned int index, int value)
+  {
+    assert(runs.empty() || index >= runs.back().index + runs.back().count);
+    if (value == 0)
+      return;
+
+    if (!runs.empty() && runs.back().index + runs.back().count == index) {
+      DataRun &last = runs.back();
+      if (last.repeat && last.value == value) {
+        ++last.count;
+        return;
+      } else if (!last.repeat) {
+        words.emplace_back(value);
+        ++last.count;
+        split_repeat();
+        return;
+      }
+    }
+
+    runs.push_back({index, 1, false, static_cast<int>(words.size())});
+    words.emplace_back(value);
+  }
+
+  int at(unsigned int index) const
+  {
+    auto it = std::upper_bound(runs.begin(), runs.end(), index,
+        [] (unsigned int index, const DataRun &run) {
+          return index < run.index;
+        });
+    if (it == runs.begin())
+      return 0;
+    --it;
+    if (index - it->index >= it->count)
+      return 0;
+    return it->repeat ? it->value : words[it->value + index - it->index];
+  }
+
+  const int *get_words(const DataRun &run) const
+  {
+    assert(!run.repeat);
+    return words.data() + run.value;
+  }
+
+  bool empty(void) const
+  {
+    return runs.empty();
+  }
+
+  const_iterator begin(void) const
+  {
+    return runs.begin();
+  }
+
+  const_iterator end(void) const
+  {
+    return runs.end();
+  }
+
+private:
+  /* Moves a tail of equal words of the last run into a repeated run. */
+  void split_repeat(void)
+  {
+    DataRun &last = runs.back();
+    if (last.count < DATA_RUN_MIN_REPEAT)
+      return;
+    int value = words.back();
+    for (size_t i = 1; i < DATA_RUN_MIN_REPEAT; ++i)
+      if (words[words.size() - 1 - i] != value)
+        return;
+
+    unsigned int index = last.index + last.count - DATA_RUN_MIN_REPEAT;
+    words.resize(words.size() - DATA_RUN_MIN_REPEAT);
+    last.count -= DATA_RUN_MIN_REPEAT;
+    if (last.count == 0)
+      runs.pop_back();
+    runs.push_back({index, DATA_RUN_MIN_REPEAT, true, value});
+  }
+
+private:
+  std::vector<DataRun> runs;
+  std::vector<int> words;
+};